@@ -0,0 +1,135 @@
+// Compare the allocation throughput of std::allocator and arena_allocator,
+// both raw and when building many small containers
+
+#include <clue/memory.hpp>
+#include <clue/fast_vector.hpp>
+#include <clue/keyed_vector.hpp>
+#include <clue/ordered_dict.hpp>
+#include <clue/timing.hpp>
+#include <vector>
+#include <cstdio>
+
+using namespace clue;
+
+const size_t R = 50;     // # rounds
+const size_t M = 2000;   // # containers (or blocks) per round
+const size_t K = 16;     // # elements per container
+
+void report(const char *name, size_t nitems, double et) {
+    std::printf("%-36s: %8.2f M items/sec\n", name, nitems * 1.0e-6 / et);
+}
+
+// allocate M blocks of varying sizes, then free them all
+template<class Alloc>
+long raw_round(Alloc& alloc, std::vector<long*>& ptrs) {
+    long s = 0;
+    for (size_t i = 0; i < M; ++i) {
+        long *p = alloc.allocate(1 + i % 8);
+        p[0] = (long)i;
+        ptrs[i] = p;
+    }
+    for (size_t i = 0; i < M; ++i) {
+        s += ptrs[i][0];
+        alloc.deallocate(ptrs[i], 1 + i % 8);
+    }
+    return s;
+}
+
+// build M containers of K entries through make, and tear them down
+template<class Make>
+long build_round(Make&& make) {
+    long s = 0;
+    for (size_t i = 0; i < M; ++i) {
+        auto c = make();
+        for (size_t k = 0; k < K; ++k) c.push_back((long)k);
+        s += (long)c.size();
+    }
+    return s;
+}
+
+template<class Std, class Arena>
+void compare(const char *name, Std&& run_std, Arena&& run_arena) {
+    char buf[64];
+    monotonic_arena arena;
+    long s0 = 0, s1 = 0;
+
+    stop_watch sw(true);
+    for (size_t r = 0; r < R; ++r) s0 += run_std();
+    double et = sw.elapsed().secs();
+    std::snprintf(buf, sizeof(buf), "%s (std::allocator)", name);
+    report(buf, R * M, et);
+
+    sw.reset();
+    sw.start();
+    for (size_t r = 0; r < R; ++r) {
+        s1 += run_arena(arena);
+        arena.reset();
+    }
+    et = sw.elapsed().secs();
+    std::snprintf(buf, sizeof(buf), "%s (arena_allocator)", name);
+    report(buf, R * M, et);
+
+    CLUE_ASSERT(s0 == s1);
+}
+
+template<class T>
+struct kv_adapter {
+    T c;
+    void push_back(long k) { c.push_back(k, k); }
+    size_t size() const { return c.size(); }
+};
+
+template<class T>
+struct dict_adapter {
+    T c;
+    void push_back(long k) { c[k] = k; }
+    size_t size() const { return c.size(); }
+};
+
+int main() {
+    std::vector<long*> ptrs(M);
+
+    compare("raw blocks",
+        [&](){
+            std::allocator<long> a;
+            return raw_round(a, ptrs);
+        },
+        [&](monotonic_arena& arena){
+            arena_allocator<long> a(arena);
+            return raw_round(a, ptrs);
+        });
+
+    compare("fast_vector",
+        [](){
+            return build_round([](){ return fast_vector<long>(); });
+        },
+        [](monotonic_arena& arena){
+            typedef fast_vector<long, 0, true, arena_allocator<long>> vec_t;
+            return build_round([&](){ return vec_t(arena); });
+        });
+
+    compare("keyed_vector",
+        [](){
+            typedef keyed_vector<long, long> kv_t;
+            return build_round([](){ return kv_adapter<kv_t>(); });
+        },
+        [](monotonic_arena& arena){
+            typedef arena_allocator<long> alloc_t;
+            typedef keyed_vector<long, long, std::hash<long>, alloc_t> kv_t;
+            return build_round([&](){ return kv_adapter<kv_t>{kv_t(alloc_t(arena))}; });
+        });
+
+    compare("ordered_dict",
+        [](){
+            typedef ordered_dict<long, long> dict_t;
+            return build_round([](){ return dict_adapter<dict_t>(); });
+        },
+        [](monotonic_arena& arena){
+            typedef arena_allocator<std::pair<long, long>> alloc_t;
+            typedef ordered_dict<long, long, std::hash<long>,
+                                 std::equal_to<long>, alloc_t> dict_t;
+            return build_round([&](){ return dict_adapter<dict_t>{dict_t(alloc_t(arena))}; });
+        });
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Compare the throughput of the concurrent queues
+// in a single-producer/single-consumer pipeline
+
+#include <clue/concurrent_queue.hpp>
+#include <clue/concurrent_ring_queue.hpp>
+#include <clue/spsc_queue.hpp>
+#include <clue/timing.hpp>
+#include <thread>
+#include <cstdio>
+
+using namespace clue;
+
+const long N = 2000000;  // # items to pass through the queue
+const size_t B = 64;     // batch size for push_n/pop_n
+
+template<class Producer, class Consumer>
+void run(const char *name, Producer&& produce, Consumer&& consume) {
+    long total = 0;
+    stop_watch sw(true);
+    std::thread producer([&](){
+        for (long i = 0; i < N; ++i) produce(i + 1);
+    });
+    std::thread consumer([&](){
+        for (long i = 0; i < N; ++i) total += consume();
+    });
+    producer.join();
+    consumer.join();
+    double et = sw.elapsed().secs();
+
+    CLUE_ASSERT(total == N * (N + 1) / 2);
+    std::printf("%-28s: %8.2f M items/sec\n", name, N * 1.0e-6 / et);
+}
+
+void run_spsc_batch() {
+    spsc_queue<long> Q(4096);
+    long total = 0;
+
+    stop_watch sw(true);
+    std::thread producer([&](){
+        long buf[B];
+        for (long i = 0; i < N; i += B) {
+            size_t m = 0;
+            for (; m < B && i + (long)m < N; ++m) buf[m] = i + (long)m + 1;
+            for (size_t k = 0; k < m;) {
+                size_t r = Q.push_n(buf + k, m - k);
+                if (r == 0) std::this_thread::yield();
+                k += r;
+            }
+        }
+    });
+    std::thread consumer([&](){
+        long buf[B];
+        for (long n = 0; n < N;) {
+            size_t r = Q.pop_n(buf, B);
+            if (r == 0) std::this_thread::yield();
+            for (size_t k = 0; k < r; ++k) total += buf[k];
+            n += (long)r;
+        }
+    });
+    producer.join();
+    consumer.join();
+    double et = sw.elapsed().secs();
+
+    CLUE_ASSERT(total == N * (N + 1) / 2);
+    std::printf("%-28s: %8.2f M items/sec\n", "spsc_queue (push_n/pop_n)", N * 1.0e-6 / et);
+}
+
+int main() {
+    {
+        concurrent_queue<long> Q;
+        run("concurrent_queue",
+            [&](long v){ Q.push(v); },
+            [&](){ return Q.wait_pop(); });
+    }
+    {
+        concurrent_queue<long, std::deque<long>, spin_then_park<>> Q;
+        run("concurrent_queue (spinning)",
+            [&](long v){ Q.push(v); },
+            [&](){ return Q.wait_pop(); });
+    }
+    {
+        concurrent_ring_queue<long> Q(4096);
+        run("concurrent_ring_queue",
+            [&](long v){ Q.push(v); },
+            [&](){ return Q.wait_pop(); });
+    }
+    {
+        spsc_queue<long> Q(4096);
+        run("spsc_queue",
+            [&](long v){ Q.push(v); },
+            [&](){ return Q.wait_pop(); });
+    }
+    run_spsc_batch();
+    return 0;
+}
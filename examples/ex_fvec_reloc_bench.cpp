@@ -0,0 +1,58 @@
+// Compare fast_vector with relocatable elements (moved by memcpy/memmove)
+// against element-by-element moves, on insert/erase-heavy workloads
+
+#include <clue/fast_vector.hpp>
+#include <clue/timing.hpp>
+#include <memory>
+#include <utility>
+#include <cstdio>
+
+using namespace clue;
+
+const size_t N = 2000;   // # elements kept in the vector
+const size_t R = 20000;  // # insert/erase rounds
+
+// repeatedly insert near the front and erase in the middle,
+// then grow the vector by push_back
+template<class Vec, class Make>
+double run(Make&& make) {
+    Vec v;
+    for (size_t i = 0; i < N; ++i) v.push_back(make(i));
+
+    stop_watch sw(true);
+    for (size_t r = 0; r < R; ++r) {
+        v.insert(v.begin() + (r % 16), make(r));
+        v.erase(v.begin() + (r * 7919) % v.size());
+    }
+    Vec w;
+    for (size_t i = 0; i < N * 100; ++i) w.push_back(make(i));
+    double et = sw.elapsed().secs();
+
+    CLUE_ASSERT(v.size() == N && w.size() == N * 100);
+    return et;
+}
+
+template<class T, class Make>
+void compare(const char *name, Make&& make) {
+    static_assert(is_relocatable<T>::value, "T should be relocatable");
+    double t0 = run<fast_vector<T, 0, false>>(make);
+    double t1 = run<fast_vector<T>>(make);
+    std::printf("%-32s: %8.2f ms (move) %8.2f ms (relocate), speedup = %.2fx\n",
+        name, t0 * 1.0e3, t1 * 1.0e3, t0 / t1);
+}
+
+int main() {
+    compare<std::unique_ptr<long>>("unique_ptr<long>", [](size_t i){
+        return std::unique_ptr<long>(new long(static_cast<long>(i)));
+    });
+    compare<std::shared_ptr<long>>("shared_ptr<long>", [](size_t i){
+        return std::make_shared<long>(static_cast<long>(i));
+    });
+    compare<std::pair<int, float>>("pair<int, float>", [](size_t i){
+        return std::make_pair(static_cast<int>(i), 1.0f);
+    });
+    compare<fast_vector<int>>("fast_vector<int>", [](size_t i){
+        return fast_vector<int>(i % 4, 1);
+    });
+    return 0;
+}
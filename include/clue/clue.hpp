@@ -28,13 +28,25 @@
 #include <clue/optional.hpp>
 #include <clue/timing.hpp>
 #include <clue/memory.hpp>
+#include <clue/object_pool.hpp>
 #include <clue/type_name.hpp>
 #include <clue/textio.hpp>
 
 // concurrency
 #include <clue/shared_mutex.hpp>
+#include <clue/rcu.hpp>
+#include <clue/seqlock.hpp>
+#include <clue/lock_profiler.hpp>
 #include <clue/concurrent_queue.hpp>
+#include <clue/concurrent_ring_queue.hpp>
+#include <clue/spsc_queue.hpp>
 #include <clue/concurrent_counter.hpp>
+#include <clue/sharded_counter.hpp>
+#include <clue/cpu_affinity.hpp>
+#include <clue/task_function.hpp>
 #include <clue/thread_pool.hpp>
+#include <clue/task_graph.hpp>
+#include <clue/parallel_algorithms.hpp>
+#include <clue/work_stealing_pool.hpp>
 
 #endif
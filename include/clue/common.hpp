@@ -28,6 +28,13 @@
 #define CLUE_UNLIKELY(x) (x)
 #endif
 
+// the size of a cache line, which is used to pad the data that
+// are frequently updated by different threads (to avoid false sharing)
+//
+#ifndef CLUE_CACHELINE_SIZE
+#define CLUE_CACHELINE_SIZE 64
+#endif
+
 #define CLUE_REQUIRE(...) typename std::enable_if<(__VA_ARGS__), int>::type = 0
 
 namespace clue {
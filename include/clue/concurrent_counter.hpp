@@ -2,61 +2,56 @@
 #define CLUE_CONCURRENT_COUNTER__
 
 #include <clue/predicates.hpp>
+#include <clue/spin_wait.hpp>
+#include <atomic>
 #include <mutex>
 #include <chrono>
 #include <condition_variable>
 
 namespace clue {
 
+// The count is held in an atomic variable, so that get/set/inc/dec
+// never lock. Only the threads that have to wait for a condition
+// take the mutex, and the updaters notify them only if there are any.
 class concurrent_counter {
 public:
     typedef long value_type;
     typedef std::mutex mutex_type;
 
 private:
-    value_type cnt_;
+    std::atomic<value_type> cnt_;
+    std::atomic<size_t> n_waiters_;
     mutable mutex_type mut_;
     std::condition_variable cv_;
 
 public:
     concurrent_counter()
-        : cnt_(0) {}
+        : cnt_(0), n_waiters_(0) {}
 
     explicit concurrent_counter(long v0)
-        : cnt_(v0) {}
+        : cnt_(v0), n_waiters_(0) {}
 
     long get() const {
-        std::lock_guard<mutex_type> lk(mut_);
-        return cnt_;
+        return cnt_.load();
     }
 
     void set(long x) {
-        if (x != cnt_) {
-            {
-                std::lock_guard<mutex_type> lk(mut_);
-                cnt_ = x;
-            }
-            cv_.notify_all();
+        if (cnt_.exchange(x) != x) {
+            notify_waiters();
         }
     }
 
     void inc(long x = 1) {
         if (x != 0) {
-            {
-                std::lock_guard<mutex_type> lk(mut_);
-                cnt_ += x;
-            }
-            cv_.notify_all();
+            cnt_.fetch_add(x);
+            notify_waiters();
         }
     }
 
     void dec(long x = 1) {
         if (x != 0) {
-            {
-                std::lock_guard<mutex_type> lk(mut_);
-                cnt_ -= x;
-            }
-            cv_.notify_all();
+            cnt_.fetch_sub(x);
+            notify_waiters();
         }
     }
 
@@ -64,20 +59,31 @@ public:
 
     template<class Pred>
     void wait(Pred&& pred) {
+        if (pred(get())) return;
         std::unique_lock<mutex_type> lk(mut_);
-        cv_.wait(lk, [this,&pred](){ return pred(cnt_); });
+        n_waiters_ ++;
+        cv_.wait(lk, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
     }
 
     template<class Pred, class Rep, class Period>
     bool wait_for(Pred&& pred, const std::chrono::duration<Rep, Period>& dur) {
+        if (pred(get())) return true;
         std::unique_lock<mutex_type> lk(mut_);
-        return cv_.wait_for(lk, dur, [this,&pred](){ return pred(cnt_); });
+        n_waiters_ ++;
+        bool r = cv_.wait_for(lk, dur, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
+        return r;
     }
 
     template<class Pred, class Clk, class Dur>
     bool wait_until(Pred&& pred, const std::chrono::time_point<Clk, Dur>& t) {
+        if (pred(get())) return true;
         std::unique_lock<mutex_type> lk(mut_);
-        return cv_.wait_until(lk, t, [this,&pred](){ return pred(cnt_); });
+        n_waiters_ ++;
+        bool r = cv_.wait_until(lk, t, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
+        return r;
     }
 
     void wait(long v) {
@@ -93,6 +99,12 @@ public:
     bool wait_until(long v, const std::chrono::time_point<Clk, Dur>& t) {
         return wait_until(eq(v), t);
     }
+
+private:
+    // called after each update of cnt_ (see details::notify_parked)
+    void notify_waiters() {
+        details::notify_parked(n_waiters_, mut_, cv_);
+    }
 };
 
 }
@@ -2,20 +2,43 @@
 #define CLUE_CONCURRENT_QUEUE__
 
 #include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#ifdef CLUE_LOCK_PROFILING
+#include <clue/lock_profiler.hpp>
+#endif
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
 #include <queue>
 
 namespace clue {
 
-template<class T, class Container=std::deque<T>>
+// WaitPolicy decides how the internal mutex is acquired and how
+// wait_pop/wait_empty wait (see spin_wait.hpp). With spin_then_park,
+// a consumer that finds the queue empty spins for a while before it
+// sleeps, which pays off when items arrive in quick succession.
+template<class T,
+         class Container=std::deque<T>,
+         class WaitPolicy=blocking_wait>
 class concurrent_queue final {
+public:
+    typedef WaitPolicy wait_policy;
+
 private:
     using mutex_type = std::mutex;
     std::queue<T, Container> queue_;
     mutex_type mut_;
     std::condition_variable cv1_; // notify when the queue becomes non-empty
     std::condition_variable cv2_; // notify when the queue becomes empty
+    std::atomic<bool> closed_{false};  // modified only under mut_
+#ifdef CLUE_LOCK_PROFILING
+    details::lock_profile prof_{this};
+    typedef details::profiled_lock<mutex_type> lock_type;
+#else
+    typedef std::unique_lock<mutex_type> lock_type;
+#endif
 
 public:
     ~concurrent_queue() {
@@ -30,32 +53,60 @@ public:
         return queue_.empty();
     }
 
+    bool closed() const {
+        return closed_.load();
+    }
+
+    // tag the queue in the lock profiles (see lock_profiler.hpp),
+    // which is a no-op unless CLUE_LOCK_PROFILING is defined
+    void set_name(const char *name) {
+#ifdef CLUE_LOCK_PROFILING
+        prof_.set_name(name);
+#else
+        (void)name;
+#endif
+    }
+
     void synchronize() {
-        std::lock_guard<mutex_type> lk(mut_);
+        auto lk = lock_();
     }
 
     void clear() {
-        std::lock_guard<mutex_type> lk(mut_);
+        auto lk = lock_();
         while (!empty()) {
             queue_.pop();
         }
     }
 
+    // Close the queue: no more elements can be pushed (push throws), and
+    // the consumers waiting on an empty queue return without an element.
+    // The remaining elements can still be popped.
+    void close() {
+        {
+            auto lk = lock_();
+            closed_ = true;
+        }
+        cv1_.notify_all();
+    }
+
     void push(const T& x) {
-        std::lock_guard<mutex_type> lk(mut_);
+        auto lk = lock_();
+        check_open_();
         queue_.push(x);
         if (size() == 1) cv1_.notify_all();
     }
 
     void push(T&& x) {
-        std::lock_guard<mutex_type> lk(mut_);
+        auto lk = lock_();
+        check_open_();
         queue_.push(std::move(x));
         if (size() == 1) cv1_.notify_all();
     }
 
     template<class... Args>
     void push(Args&&... args) {
-        std::lock_guard<mutex_type> lk(mut_);
+        auto lk = lock_();
+        check_open_();
         queue_.emplace(std::forward<Args>(args)...);
         if (size() == 1) cv1_.notify_all();
     }
@@ -63,28 +114,114 @@ public:
     // If it is non empty, pop and write the front element to dst,
     // and return true, otherwise, it returns false immediately.
     bool try_pop(T& dst) {
-        std::lock_guard<mutex_type> lk(mut_);
-        if (empty()) return false;
-        dst = std::move(queue_.front());
-        queue_.pop();
-        if (empty()) cv2_.notify_all();
-        return true;
+        auto lk = lock_();
+        return pop_locked_(dst);
     }
 
-    // Wait until non-empty and then pop
+    // Wait until non-empty and then pop. It throws std::runtime_error
+    // if the queue is (or becomes) closed and empty (wait_pop(dst)
+    // reports that by returning false instead).
     T wait_pop() {
-        std::unique_lock<mutex_type> lk(mut_);
-        cv1_.wait(lk, [this](){ return !empty(); });
+        auto lk = lock_();
+        wait_(lk, cv1_, [this](){ return !empty() || closed(); });
+        if (empty()) {
+            throw std::runtime_error("concurrent_queue::wait_pop: the queue is closed.");
+        }
         T x = std::move(queue_.front());
         queue_.pop();
         if (empty()) cv2_.notify_all();
-        return std::move(x);
+        return x;
+    }
+
+    // Wait until non-empty, then pop and write the front element to dst,
+    // and return true. It returns false if the queue is closed and empty.
+    bool wait_pop(T& dst) {
+        auto lk = lock_();
+        wait_(lk, cv1_, [this](){ return !empty() || closed(); });
+        return pop_locked_(dst);
+    }
+
+    // Like wait_pop(dst), but it also returns false upon timeout.
+    template<class Rep, class Period>
+    bool wait_pop_for(T& dst, const std::chrono::duration<Rep, Period>& dur) {
+        return wait_pop_until(dst, std::chrono::steady_clock::now() + dur);
+    }
+
+    template<class Clock, class Duration>
+    bool wait_pop_until(T& dst, const std::chrono::time_point<Clock, Duration>& t) {
+        auto lk = lock_();
+        wait_until_(lk, cv1_, t, [this](){ return !empty() || closed(); });
+        return pop_locked_(dst);
+    }
+
+    // Pop all elements and write them (in order) to out, an output
+    // iterator, and return the number of elements. The elements are
+    // taken in one swap under the lock, and moved to out after the
+    // lock is released.
+    template<class OutputIt>
+    size_t pop_all(OutputIt out) {
+        std::queue<T, Container> q;
+        {
+            auto lk = lock_();
+            if (empty()) return 0;
+            q.swap(queue_);
+            cv2_.notify_all();
+        }
+        size_t n = q.size();
+        while (!q.empty()) {
+            *out = std::move(q.front());
+            ++out;
+            q.pop();
+        }
+        return n;
     }
 
     // Wait until empty
     void wait_empty() {
-        std::unique_lock<mutex_type> lk(mut_);
-        cv2_.wait(lk, [this](){ return empty(); });
+        auto lk = lock_();
+        wait_(lk, cv2_, [this](){ return empty(); });
+    }
+
+private:
+    void check_open_() const {
+        if (closed()) {
+            throw std::runtime_error("concurrent_queue::push: the queue is closed.");
+        }
+    }
+
+    bool pop_locked_(T& dst) {
+        if (empty()) return false;
+        dst = std::move(queue_.front());
+        queue_.pop();
+        if (empty()) cv2_.notify_all();
+        return true;
+    }
+
+    lock_type lock_() {
+#ifdef CLUE_LOCK_PROFILING
+        prof_.acquire<WaitPolicy>(mut_);
+        return lock_type(mut_, std::adopt_lock, prof_);
+#else
+        WaitPolicy::lock(mut_);
+        return lock_type(mut_, std::adopt_lock);
+#endif
+    }
+
+    template<class Pred>
+    void wait_(lock_type& lk, std::condition_variable& cv, Pred&& pred) {
+        WaitPolicy::wait(lk, cv, std::forward<Pred>(pred));
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_reacquire();
+#endif
+    }
+
+    template<class Clock, class Duration, class Pred>
+    void wait_until_(lock_type& lk, std::condition_variable& cv,
+                     const std::chrono::time_point<Clock, Duration>& t, Pred&& pred) {
+        WaitPolicy::wait_until(lk, cv, t, std::forward<Pred>(pred));
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_reacquire();
+#endif
     }
 };
 
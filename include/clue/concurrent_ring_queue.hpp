@@ -0,0 +1,323 @@
+/**
+ * @file concurrent_ring_queue.hpp
+ *
+ * A lock-free bounded multi-producer/multi-consumer queue.
+ *
+ * @note
+ *
+ *   The algorithm follows Dmitry Vyukov's bounded MPMC queue:
+ *   each cell carries a sequence number that tells whether it
+ *   is ready to be written (seq == pos) or read (seq == pos + 1),
+ *   so producers and consumers only contend on their own index.
+ */
+
+#ifndef CLUE_CONCURRENT_RING_QUEUE__
+#define CLUE_CONCURRENT_RING_QUEUE__
+
+#include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#include <atomic>
+#include <memory>
+#include <limits>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+
+namespace clue {
+
+template<class T>
+class concurrent_ring_queue final {
+private:
+    using mutex_type = std::mutex;
+    using storage_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    // A cell whose element failed to be constructed is published as a
+    // hole, which consumers skip (the claimed position cannot be given
+    // back). The flag is published along with seq.
+    struct cell_t {
+        std::atomic<size_t> seq;
+        bool hole = false;
+        storage_t data;
+
+        T* ptr() noexcept {
+            return reinterpret_cast<T*>(&data);
+        }
+    };
+
+    // the indices updated by producers and consumers are put on
+    // separate cache lines, away from the read-only fields
+    char pad0_[CLUE_CACHELINE_SIZE];
+    std::atomic<size_t> enq_pos_;
+    char pad1_[CLUE_CACHELINE_SIZE - sizeof(size_t)];
+    std::atomic<size_t> deq_pos_;
+    char pad2_[CLUE_CACHELINE_SIZE - sizeof(size_t)];
+
+    const size_t mask_;
+    std::unique_ptr<cell_t[]> cells_;
+    // # holes published and not yet skipped by a consumer
+    std::atomic<size_t> n_holes_;
+
+    // for parking the threads that have spinned for too long
+    mutex_type mut_;
+    std::condition_variable cv_nonempty_;
+    std::condition_variable cv_nonfull_;
+    std::condition_variable cv_empty_;
+    std::atomic<size_t> n_wait_pop_;
+    std::atomic<size_t> n_wait_push_;
+    std::atomic<size_t> n_wait_empty_;
+
+public:
+    // the capacity is rounded up to a power of two (at least 2),
+    // std::length_error is thrown if that overflows
+    explicit concurrent_ring_queue(size_t cap)
+        : enq_pos_(0)
+        , deq_pos_(0)
+        , mask_(round_cap_(cap) - 1)
+        , cells_(new cell_t[mask_ + 1])
+        , n_holes_(0)
+        , n_wait_pop_(0)
+        , n_wait_push_(0)
+        , n_wait_empty_(0) {
+        for (size_t i = 0; i <= mask_; ++i) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    concurrent_ring_queue(const concurrent_ring_queue&) = delete;
+    concurrent_ring_queue& operator=(const concurrent_ring_queue&) = delete;
+
+    ~concurrent_ring_queue() {
+        clear();
+    }
+
+    size_t capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+    // the number of elements, holes excluded (it is approximate
+    // when some other threads are pushing or popping)
+    size_t size() const noexcept {
+        size_t d = deq_pos_.load();
+        size_t e = enq_pos_.load();
+        size_t h = n_holes_.load();
+        return e > d + h ? e - d - h : 0;
+    }
+
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    bool full() const noexcept {
+        return size() >= capacity();
+    }
+
+    void clear() {
+        cell_t *c;
+        size_t pos;
+        while ((c = claim_elem_(pos)) != nullptr) {
+            c->ptr()->~T();
+            release_pop_(c, pos);
+        }
+    }
+
+    // If it is not full, construct an element from args
+    // at the back and return true, otherwise return false
+    // immediately (args are left untouched).
+    //
+    // If the construction throws, nothing is pushed, and the
+    // exception is propagated (the queue remains usable).
+    template<class... Args>
+    bool try_push(Args&&... args) {
+        size_t pos;
+        cell_t *c = claim_push_(pos);
+        if (!c) return false;
+        construct_(c, pos, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // Push an element, spin and then wait while the queue is full
+    template<class... Args>
+    void push(Args&&... args) {
+        size_t pos;
+        cell_t *c = claim_push_(pos);
+        spin_wait sw;
+        while (!c) {
+            if (!sw.spin_once()) {
+                park_(cv_nonfull_, n_wait_push_, [this](){ return can_push_(); });
+            }
+            c = claim_push_(pos);
+        }
+        construct_(c, pos, std::forward<Args>(args)...);
+    }
+
+    // If it is non empty, pop and write the front element to dst,
+    // and return true, otherwise, it returns false immediately.
+    //
+    // If the move-assignment throws, the element is popped (and
+    // destroyed) anyway, and the exception is propagated.
+    bool try_pop(T& dst) {
+        size_t pos;
+        cell_t *c = claim_elem_(pos);
+        if (!c) return false;
+        pop_guard_t g{this, c, pos};
+        dst = std::move(*(c->ptr()));
+        return true;
+    }
+
+    // Spin and then wait until non-empty, and then pop
+    // (an exception from the move-construction is handled
+    // as in try_pop)
+    T wait_pop() {
+        size_t pos;
+        cell_t *c = claim_elem_(pos);
+        spin_wait sw;
+        while (!c) {
+            if (!sw.spin_once()) {
+                park_(cv_nonempty_, n_wait_pop_, [this](){ return can_pop_(); });
+            }
+            c = claim_elem_(pos);
+        }
+        pop_guard_t g{this, c, pos};
+        return T(std::move(*(c->ptr())));
+    }
+
+    // Spin and then wait until empty
+    void wait_empty() {
+        spin_wait sw;
+        while (!empty()) {
+            if (!sw.spin_once()) {
+                park_(cv_empty_, n_wait_empty_, [this](){ return empty(); });
+            }
+        }
+    }
+
+private:
+    static size_t round_cap_(size_t cap) {
+        if (cap > (std::numeric_limits<size_t>::max() >> 1) + 1) {
+            throw std::length_error(
+                "concurrent_ring_queue: the capacity is too large.");
+        }
+        size_t c = 2;
+        while (c < cap) c <<= 1;
+        return c;
+    }
+
+    // acquire the cell at the back, or return nullptr if full
+    cell_t* claim_push_(size_t& pos) {
+        pos = enq_pos_.load(std::memory_order_relaxed);
+        for(;;) {
+            cell_t *c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = static_cast<ptrdiff_t>(seq - pos);
+            if (dif == 0) {
+                if (enq_pos_.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) return c;
+            } else if (dif < 0) {
+                return nullptr;
+            } else {
+                pos = enq_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // acquire the cell at the front, or return nullptr if empty
+    cell_t* claim_pop_(size_t& pos) {
+        pos = deq_pos_.load(std::memory_order_relaxed);
+        for(;;) {
+            cell_t *c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = static_cast<ptrdiff_t>(seq - (pos + 1));
+            if (dif == 0) {
+                if (deq_pos_.compare_exchange_weak(pos, pos + 1,
+                        std::memory_order_relaxed)) return c;
+            } else if (dif < 0) {
+                return nullptr;
+            } else {
+                pos = deq_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // construct an element in a claimed cell and publish it,
+    // or publish the cell as a hole if the construction throws
+    template<class... Args>
+    void construct_(cell_t *c, size_t pos, Args&&... args) {
+        try {
+            new(c->ptr()) T(std::forward<Args>(args)...);
+        } catch (...) {
+            c->hole = true;
+            n_holes_ ++;
+            release_push_(c, pos);
+            // the hole may have been all that kept the queue non-empty
+            notify_empty_();
+            throw;
+        }
+        c->hole = false;
+        release_push_(c, pos);
+    }
+
+    // claim the cell at the front, skipping holes,
+    // or return nullptr if empty
+    cell_t* claim_elem_(size_t& pos) {
+        for(;;) {
+            cell_t *c = claim_pop_(pos);
+            if (!c || !c->hole) return c;
+            n_holes_ --;
+            release_pop_(c, pos);
+        }
+    }
+
+    // destroys the element of a claimed cell and gives the cell
+    // back upon leaving the scope (normally or by an exception)
+    struct pop_guard_t {
+        concurrent_ring_queue *q;
+        cell_t *c;
+        size_t pos;
+
+        ~pop_guard_t() {
+            c->ptr()->~T();
+            q->release_pop_(c, pos);
+        }
+    };
+
+    // publish a cell and wake the threads parked for it
+    // (see details::notify_parked)
+    void release_push_(cell_t *c, size_t pos) {
+        c->seq.store(pos + 1);
+        details::notify_parked(n_wait_pop_, mut_, cv_nonempty_, false);
+    }
+
+    void release_pop_(cell_t *c, size_t pos) {
+        c->seq.store(pos + mask_ + 1);
+        details::notify_parked(n_wait_push_, mut_, cv_nonfull_, false);
+        notify_empty_();
+    }
+
+    void notify_empty_() {
+        if (n_wait_empty_.load() > 0 && empty()) {
+            details::notify_parked(n_wait_empty_, mut_, cv_empty_);
+        }
+    }
+
+    bool can_push_() const {
+        size_t pos = enq_pos_.load();
+        return cells_[pos & mask_].seq.load() == pos;
+    }
+
+    bool can_pop_() const {
+        size_t pos = deq_pos_.load();
+        return cells_[pos & mask_].seq.load() == pos + 1;
+    }
+
+    template<class Pred>
+    void park_(std::condition_variable& cv, std::atomic<size_t>& nw, Pred&& pred) {
+        std::unique_lock<mutex_type> lk(mut_);
+        nw ++;
+        cv.wait(lk, pred);
+        nw --;
+    }
+};
+
+} // end namespace clue
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file cpu_affinity.hpp
+ *
+ * CPU affinity of threads and the CPU sets of NUMA nodes.
+ */
+
+#ifndef CLUE_CPU_AFFINITY__
+#define CLUE_CPU_AFFINITY__
+
+#include <clue/common.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace clue {
+
+// Parse a CPU list in the format used by the Linux kernel,
+// e.g. "0-3,8,10-11" (white spaces around items are ignored).
+inline std::vector<int> parse_cpu_list(const std::string& s) {
+    std::vector<int> r;
+    const char *p = s.data();
+    const char *pe = p + s.size();
+
+    auto skip_ws = [&p, pe]() {
+        while (p != pe && (*p == ' ' || *p == '\t' || *p == '\n')) ++p;
+    };
+    auto parse_int = [&p, pe]() -> int {
+        if (p == pe || *p < '0' || *p > '9') {
+            throw std::invalid_argument("parse_cpu_list: invalid CPU list.");
+        }
+        int v = 0;
+        while (p != pe && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+        return v;
+    };
+
+    skip_ws();
+    while (p != pe) {
+        int a = parse_int();
+        int b = a;
+        if (p != pe && *p == '-') {
+            ++p;
+            b = parse_int();
+            if (b < a) {
+                throw std::invalid_argument("parse_cpu_list: invalid CPU range.");
+            }
+        }
+        for (int i = a; i <= b; ++i) r.push_back(i);
+        skip_ws();
+        if (p != pe) {
+            if (*p != ',') {
+                throw std::invalid_argument("parse_cpu_list: invalid CPU list.");
+            }
+            ++p;
+            skip_ws();
+            // a comma must be followed by another element
+            if (p == pe) {
+                throw std::invalid_argument("parse_cpu_list: invalid CPU list.");
+            }
+        }
+    }
+    return r;
+}
+
+
+// a NUMA node and the CPUs that belong to it
+struct numa_node {
+    int id;
+    std::vector<int> cpus;
+};
+
+// Get the NUMA nodes (with at least one CPU) as reported by
+// /sys/devices/system/node. It returns an empty list when the
+// information is not available (e.g. on non-Linux systems).
+inline std::vector<numa_node> numa_nodes() {
+    std::vector<numa_node> r;
+#if defined(__linux__)
+    const std::string base("/sys/devices/system/node/");
+    auto read_line = [](const std::string& path, std::string& line) {
+        std::ifstream in(path.c_str());
+        return static_cast<bool>(std::getline(in, line));
+    };
+
+    std::string line;
+    if (!read_line(base + "online", line)) return r;
+    for (int nid: parse_cpu_list(line)) {
+        std::string cl;
+        if (!read_line(base + "node" + std::to_string(nid) + "/cpulist", cl))
+            continue;
+        std::vector<int> cpus = parse_cpu_list(cl);
+        if (!cpus.empty()) r.push_back(numa_node{nid, std::move(cpus)});
+    }
+#endif
+    return r;
+}
+
+
+// Restrict the calling thread to run on the given CPUs. It returns
+// whether it succeeds (it always fails on non-Linux systems).
+inline bool pin_this_thread(const std::vector<int>& cpus) {
+#if defined(__linux__)
+    if (cpus.empty()) return false;
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    for (int c: cpus) {
+        if (c < 0 || c >= CPU_SETSIZE) return false;
+        CPU_SET(c, &cs);
+    }
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(cs), &cs) == 0;
+#else
+    return false;
+#endif
+}
+
+// Get the CPUs on which the calling thread is allowed to run
+// (an empty list when the information is not available).
+inline std::vector<int> this_thread_affinity() {
+    std::vector<int> r;
+#if defined(__linux__)
+    cpu_set_t cs;
+    CPU_ZERO(&cs);
+    if (::pthread_getaffinity_np(::pthread_self(), sizeof(cs), &cs) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) {
+            if (CPU_ISSET(c, &cs)) r.push_back(c);
+        }
+    }
+#endif
+    return r;
+}
+
+}
+
+#endif
@@ -8,14 +8,73 @@
 #define CLUE_FAST_VECTOR__
 
 #include <clue/container_common.hpp>
+#include <clue/memory.hpp>
 #include <vector>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <array>
 #include <cstring>
+#include <cstdlib>
+#include <new>
 
 namespace clue {
 
 template<typename T>
 struct is_relocatable : std::is_scalar<T> {};
 
+// Standard types that are known to be relocatable (they do not hold
+// pointers to themselves) in both libstdc++ and libc++.
+
+namespace details {
+
+// allocators and deleters are usually empty
+template<class A>
+struct is_relocatable_or_empty : std::integral_constant<bool,
+    std::is_empty<A>::value || is_relocatable<A>::value> {};
+
+} // namespace details
+
+template<typename T, class D>
+struct is_relocatable<std::unique_ptr<T, D>> :
+    details::is_relocatable_or_empty<D> {};
+
+template<typename T>
+struct is_relocatable<std::shared_ptr<T>> : std::true_type {};
+
+template<typename T>
+struct is_relocatable<std::weak_ptr<T>> : std::true_type {};
+
+template<typename T1, typename T2>
+struct is_relocatable<std::pair<T1, T2>> : std::integral_constant<bool,
+    is_relocatable<T1>::value && is_relocatable<T2>::value> {};
+
+template<>
+struct is_relocatable<std::tuple<>> : std::true_type {};
+
+template<typename T, typename... Ts>
+struct is_relocatable<std::tuple<T, Ts...>> : std::integral_constant<bool,
+    is_relocatable<T>::value && is_relocatable<std::tuple<Ts...>>::value> {};
+
+template<typename T, size_t N>
+struct is_relocatable<std::array<T, N>> : is_relocatable<T> {};
+
+// the debug-mode containers of libstdc++ are linked to their iterators
+#ifndef _GLIBCXX_DEBUG
+template<typename T, class A>
+struct is_relocatable<std::vector<T, A>> :
+    details::is_relocatable_or_empty<A> {};
+#endif
+
+// A string of libstdc++ (with the C++11 ABI) points to its own buffer when
+// it is short, so strings are only relocatable in libc++ and the old ABI.
+#if defined(_LIBCPP_VERSION) || \
+    (defined(__GLIBCXX__) && defined(_GLIBCXX_USE_CXX11_ABI) && !_GLIBCXX_USE_CXX11_ABI)
+template<typename C, class Tr, class A>
+struct is_relocatable<std::basic_string<C, Tr, A>> :
+    details::is_relocatable_or_empty<A> {};
+#endif
+
 
 namespace details {
 
@@ -33,7 +92,7 @@ struct relocate_policy<T, true> {
     static void move_disjoint(T* dst, T* src, T* src_end) noexcept {
         if (src != src_end) {
             size_t len = static_cast<size_t>(src_end - src) * sizeof(T);
-            std::memcpy(dst, src, len);
+            std::memcpy(static_cast<void*>(dst), static_cast<const void*>(src), len);
         }
     }
 
@@ -41,7 +100,7 @@ struct relocate_policy<T, true> {
     static void move_fwd(T* dst, T* src, T* src_end) noexcept {
         if (src != src_end) {
             size_t len = static_cast<size_t>(src_end - src) * sizeof(T);
-            std::memmove(dst, src, len);
+            std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), len);
         }
     }
 
@@ -49,7 +108,7 @@ struct relocate_policy<T, true> {
     static void move_bwd(T* dst, T* src, T* src_end) noexcept {
         if (src != src_end) {
             size_t len = static_cast<size_t>(src_end - src) * sizeof(T);
-            std::memmove(dst, src, len);
+            std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), len);
         }
     }
 };
@@ -81,6 +140,70 @@ struct relocate_policy<T, false> {
     }
 };
 
+// The dynamic memory of a fast_vector, obtained through the allocator.
+template<typename T, class Allocator, bool R>
+struct dynamic_mem_policy {
+    static constexpr bool use_realloc = false;
+
+    static T* allocate(Allocator& a, size_t n) {
+        return a.allocate(n);
+    }
+
+    static void deallocate(Allocator& a, T* p, size_t n) noexcept {
+        a.deallocate(p, n);
+    }
+
+    static T* reallocate(Allocator&, T*, size_t) {
+        CLUE_ASSERT(false);
+        return nullptr;
+    }
+};
+
+// With the default allocator, the memory of relocatable elements comes
+// from malloc instead, so that growing a vector can use realloc, which
+// extends the block in place when possible (or, for large blocks, remaps
+// its pages), rather than copying all elements to a new block.
+template<typename T>
+struct dynamic_mem_policy<T, std::allocator<T>, true> {
+    static constexpr bool use_realloc = true;
+
+    static T* allocate(std::allocator<T>&, size_t n) {
+        return reallocate_(nullptr, n);
+    }
+
+    // after inlining, gcc may fail to tell this block from the storage of
+    // an enclosing object, and warn (falsely) that it is not on the heap
+    static void deallocate(std::allocator<T>&, T* p, size_t) noexcept {
+#if defined(CLUE_GCC_VERSION) && !defined(__clang__) && CLUE_GCC_VERSION >= 110000
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+#endif
+        std::free(static_cast<void*>(p));
+#if defined(CLUE_GCC_VERSION) && !defined(__clang__) && CLUE_GCC_VERSION >= 110000
+#pragma GCC diagnostic pop
+#endif
+    }
+
+    // resize the block p to n elements, keeping its contents
+    static T* reallocate(std::allocator<T>&, T* p, size_t n) {
+        return reallocate_(p, n);
+    }
+
+private:
+    static T* reallocate_(T* p, size_t n) {
+        if (n > std::numeric_limits<size_t>::max() / sizeof(T)) throw std::bad_alloc();
+        void *q = std::realloc(static_cast<void*>(p), n * sizeof(T));
+        if (!q) throw std::bad_alloc();
+        return static_cast<T*>(q);
+    }
+};
+
+template<typename T, bool Reloc, class Allocator>
+using dynamic_mem_policy_t = dynamic_mem_policy<T, Allocator,
+    Reloc &&
+    std::is_same<Allocator, std::allocator<T>>::value &&
+    alignof(T) <= alignof(std::max_align_t)>;
+
 template<typename T>
 inline void destruct_range(T* first, T* last) {
     if (!std::is_trivially_destructible<T>::value) {
@@ -145,6 +268,7 @@ template<class T,
 class fast_vector final {
 private:
     using relocater = details::relocate_policy<T, Reloc>;
+    using mem_policy = details::dynamic_mem_policy_t<T, Reloc, Allocator>;
 
 public:
     static constexpr size_t static_capacity = SCap;
@@ -179,7 +303,7 @@ private:
 
     T* initmem(size_type c0) {
         if (c0 > SCap) {
-            pb_ = alloc_.allocate(c0);
+            pb_ = mem_policy::allocate(alloc_, c0);
             pe_ = pb_ + c0;
         } else {
             pb_ = ss_.begin();
@@ -192,7 +316,7 @@ private:
     void destroy() {
         clear();
         if (use_dynamic()) {
-            alloc_.deallocate(pb_, capacity());
+            mem_policy::deallocate(alloc_, pb_, capacity());
         }
     }
 
@@ -588,10 +712,11 @@ public:
                 use_new_dynamic_mem(n);
             } else {
                 // move elements to static storage
-                relocater::move_disjoint(ss_.begin(), pb_, pn_);
+                // (when SCap == 0, there is nothing to move)
+                if (SCap > 0) relocater::move_disjoint(ss_.begin(), pb_, pn_);
 
                 // release memory
-                alloc_.deallocate(pb_, n);
+                mem_policy::deallocate(alloc_, pb_, cur_cap);
 
                 // set pointers on static array
                 reset();
@@ -610,11 +735,21 @@ private:
     // Use a new dynamic storage of given capacity
     // to store the current elements
     void use_new_dynamic_mem(size_type new_cap) {
+        size_type n = size();
+        size_type cur_cap = capacity();
+
+        // resize the current block (relocatable elements only)
+        if (mem_policy::use_realloc && use_dynamic()) {
+            pb_ = mem_policy::reallocate(alloc_, pb_, new_cap);
+            pe_ = pb_ + new_cap;
+            pn_ = pb_ + n;
+            return;
+        }
+
         fast_vector tmp(details::copy_allocator(alloc_));
         tmp.initmem(new_cap);
 
         // move elements to tmp
-        size_type n = size();
         if (n > 0) {
             pe_ = pb_;
             relocater::move_disjoint(tmp.begin(), pb_, pb_ + n);
@@ -623,7 +758,7 @@ private:
 
         // release own memory
         if (use_dynamic()) {
-            alloc_.deallocate(pb_, n);
+            mem_policy::deallocate(alloc_, pb_, cur_cap);
         }
         reset();
 
@@ -692,6 +827,20 @@ private:
 
 }; // end class fast_vector
 
+// A fast_vector without static storage only holds pointers to its
+// dynamic memory (besides the allocator).
+template<class T, bool Reloc, class Allocator>
+struct is_relocatable<fast_vector<T, 0, Reloc, Allocator>> :
+    details::is_relocatable_or_empty<Allocator> {};
+
+
+// A fast_vector for large working sets, whose elements are aligned to
+// Align bytes (e.g. 64 for AVX-512 loads), and whose large buffers are
+// backed by huge pages.
+template<class T, size_t Align = 64>
+using aligned_fast_vector =
+    fast_vector<T, 0, is_relocatable<T>::value, huge_page_allocator<T, Align>>;
+
 }
 
 #endif
@@ -22,12 +22,14 @@ template<class T,
 class keyed_vector {
 private:
     using vector_type = std::vector<T, Allocator>;
+    using map_allocator = typename Allocator::template rebind<
+        std::pair<const Key, size_t>>::other;
     using map_type = std::unordered_map<
         Key,
         size_t,
         Hash,
         std::equal_to<Key>,
-        typename Allocator::template rebind<std::pair<const Key, size_t>>::other>;
+        map_allocator>;
 
 public:
     using value_type = T;
@@ -53,6 +55,10 @@ private:
 public:
     keyed_vector() = default;
 
+    explicit keyed_vector(const Allocator& alloc)
+        : vec_(alloc)
+        , imap_(map_allocator(alloc)) {}
+
     keyed_vector(const keyed_vector& other)
         : vec_(other.vec_)
         , imap_(other.imap_) {}
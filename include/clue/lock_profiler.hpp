@@ -0,0 +1,262 @@
+/**
+ * @file lock_profiler.hpp
+ *
+ * Contention profiling of the locking primitives.
+ */
+
+#ifndef CLUE_LOCK_PROFILER__
+#define CLUE_LOCK_PROFILER__
+
+#include <clue/common.hpp>
+#include <clue/timing.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+// Define CLUE_LOCK_PROFILING before including shared_mutex.hpp or
+// concurrent_queue.hpp to have each shared_mutex, shared_timed_mutex,
+// and concurrent_queue record its statistics below in the global
+// lock_registry. Otherwise, the primitives do not record anything (and
+// their set_name is a no-op), so the instrumentation costs nothing.
+//
+
+namespace clue {
+
+// the statistics of a lock
+struct lock_stats {
+    std::string name;
+    const void *address;    // the address of the lock
+    size_t acquisitions;    // # successful acquisitions
+    size_t contended;       // # acquisitions that had to wait
+    duration wait_time;     // total time spent waiting to acquire
+    duration max_hold_time; // the longest exclusive hold
+
+    double contention_rate() const noexcept {
+        return acquisitions > 0 ?
+            static_cast<double>(contended) / static_cast<double>(acquisitions) : 0.0;
+    }
+};
+
+namespace details {
+class lock_profile;
+}
+
+// The registry of all live profiled locks.
+class lock_registry {
+private:
+    mutable std::mutex mut_;
+    std::vector<details::lock_profile*> locks_;
+
+public:
+    static lock_registry& instance() {
+        static lock_registry r;
+        return r;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mut_);
+        return locks_.size();
+    }
+
+    // the statistics of all live locks (in the order of creation)
+    std::vector<lock_stats> stats() const;
+
+    // the statistics of the (at most) n most contended locks, in
+    // descending order of contended acquisitions, then of wait time
+    std::vector<lock_stats> top_contended(size_t n) const {
+        std::vector<lock_stats> r = stats();
+        std::stable_sort(r.begin(), r.end(), [](const lock_stats& a, const lock_stats& b){
+            return a.contended > b.contended ||
+                (a.contended == b.contended && a.wait_time.nsecs() > b.wait_time.nsecs());
+        });
+        if (r.size() > n) r.resize(n);
+        return r;
+    }
+
+    // write a table of the top n contended locks to out
+    void dump(std::ostream& out, size_t n = 10) const {
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "%-32s %12s %12s %8s %12s %12s\n",
+            "lock", "acquired", "contended", "rate", "wait (ms)", "max hold(us)");
+        out << buf;
+        for (const lock_stats& s: top_contended(n)) {
+            std::string name = s.name.empty() ? "(unnamed)" : s.name;
+            if (name.size() > 32) name.resize(32);
+            std::snprintf(buf, sizeof(buf), "%-32s %12zu %12zu %7.2f%% %12.3f %12.3f\n",
+                name.c_str(), s.acquisitions, s.contended,
+                s.contention_rate() * 100.0,
+                s.wait_time.msecs(), s.max_hold_time.usecs());
+            out << buf;
+        }
+    }
+
+    // reset the statistics of all live locks
+    void reset();
+
+private:
+    friend class details::lock_profile;
+
+    lock_registry() = default;
+
+    void add_(details::lock_profile *p) {
+        std::lock_guard<std::mutex> lk(mut_);
+        locks_.push_back(p);
+    }
+
+    void remove_(details::lock_profile *p) {
+        std::lock_guard<std::mutex> lk(mut_);
+        locks_.erase(std::remove(locks_.begin(), locks_.end(), p), locks_.end());
+    }
+};
+
+
+namespace details {
+
+// The profile of a lock, which registers itself upon construction.
+// The counters are atomic (relaxed), and the hold anchor is only
+// accessed by the exclusive holder.
+class lock_profile {
+private:
+    using clock_t = std::chrono::high_resolution_clock;
+
+    const void *owner_;
+    std::string name_;   // accessed under the registry's mutex
+    std::atomic<uint64_t> n_acq_;
+    std::atomic<uint64_t> n_cont_;
+    std::atomic<int64_t> wait_ns_;
+    std::atomic<int64_t> max_hold_ns_;
+    clock_t::time_point hold_anchor_;
+
+public:
+    explicit lock_profile(const void *owner)
+        : owner_(owner)
+        , n_acq_(0), n_cont_(0), wait_ns_(0), max_hold_ns_(0) {
+        lock_registry::instance().add_(this);
+    }
+
+    ~lock_profile() {
+        lock_registry::instance().remove_(this);
+    }
+
+    lock_profile(const lock_profile&) = delete;
+    lock_profile& operator=(const lock_profile&) = delete;
+
+    void set_name(const char *name) {
+        std::lock_guard<std::mutex> lk(lock_registry::instance().mut_);
+        name_ = name;
+    }
+
+    // record a shared acquisition (whose hold time is not tracked)
+    void on_acquire_shared(bool contended, const stop_watch& sw) noexcept {
+        n_acq_.fetch_add(1, std::memory_order_relaxed);
+        if (contended) {
+            n_cont_.fetch_add(1, std::memory_order_relaxed);
+            wait_ns_.fetch_add(static_cast<int64_t>(sw.elapsed().nsecs()),
+                               std::memory_order_relaxed);
+        }
+    }
+
+    // record an exclusive acquisition (by the calling thread)
+    void on_acquire(bool contended, const stop_watch& sw) noexcept {
+        on_acquire_shared(contended, sw);
+        hold_anchor_ = clock_t::now();
+    }
+
+    // re-anchor the hold time after the exclusive holder has
+    // released and re-acquired the lock in a condition wait
+    void on_reacquire() noexcept {
+        hold_anchor_ = clock_t::now();
+    }
+
+    // record the release of an exclusive hold
+    void on_release() noexcept {
+        int64_t h = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_t::now() - hold_anchor_).count();
+        int64_t m = max_hold_ns_.load(std::memory_order_relaxed);
+        while (h > m && !max_hold_ns_.compare_exchange_weak(
+                m, h, std::memory_order_relaxed)) {}
+    }
+
+    // Acquire m through WaitPolicy (as an exclusive hold). The
+    // acquisition is contended if m is not available at once.
+    template<class WaitPolicy, class Mutex>
+    void acquire(Mutex& m) {
+        stop_watch sw;
+        bool contended = !m.try_lock();
+        if (contended) {
+            sw.start();
+            WaitPolicy::lock(m);
+        }
+        on_acquire(contended, sw);
+    }
+
+    void reset() noexcept {
+        n_acq_ = 0;
+        n_cont_ = 0;
+        wait_ns_ = 0;
+        max_hold_ns_ = 0;
+    }
+
+private:
+    friend class ::clue::lock_registry;
+
+    lock_stats stats_() const {
+        typedef std::chrono::high_resolution_clock::duration d_t;
+        auto ns = [](int64_t v) {
+            return duration(std::chrono::duration_cast<d_t>(std::chrono::nanoseconds(v)));
+        };
+        lock_stats s;
+        s.name = name_;
+        s.address = owner_;
+        s.acquisitions = static_cast<size_t>(n_acq_.load(std::memory_order_relaxed));
+        s.contended = static_cast<size_t>(n_cont_.load(std::memory_order_relaxed));
+        s.wait_time = ns(wait_ns_.load(std::memory_order_relaxed));
+        s.max_hold_time = ns(max_hold_ns_.load(std::memory_order_relaxed));
+        return s;
+    }
+};
+
+// A unique lock that records the hold time when it releases the
+// lock upon destruction.
+template<class Mutex>
+class profiled_lock : public std::unique_lock<Mutex> {
+private:
+    lock_profile *prof_;
+
+public:
+    profiled_lock(Mutex& m, std::adopt_lock_t, lock_profile& prof)
+        : std::unique_lock<Mutex>(m, std::adopt_lock)
+        , prof_(&prof) {}
+
+    profiled_lock(profiled_lock&&) = default;
+
+    ~profiled_lock() {
+        if (this->owns_lock()) prof_->on_release();
+    }
+};
+
+} // end namespace details
+
+
+inline std::vector<lock_stats> lock_registry::stats() const {
+    std::lock_guard<std::mutex> lk(mut_);
+    std::vector<lock_stats> r;
+    r.reserve(locks_.size());
+    for (const details::lock_profile *p: locks_) r.push_back(p->stats_());
+    return r;
+}
+
+inline void lock_registry::reset() {
+    std::lock_guard<std::mutex> lk(mut_);
+    for (details::lock_profile *p: locks_) p->reset();
+}
+
+}
+
+#endif
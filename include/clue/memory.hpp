@@ -3,6 +3,9 @@
 
 #include <clue/common.hpp>
 #include <new>  // for std::bad_alloc
+#include <limits>
+#include <type_traits>
+#include <cstdint>
 
 #if (defined(_WIN32) || defined(_WIN64)) && defined(_MSC_VER)
 #include <malloc.h>
@@ -10,6 +13,10 @@
 #include <stdlib.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 namespace clue {
 
 #if (defined(_WIN32) || defined(_WIN64)) && defined(_MSC_VER)
@@ -48,6 +55,350 @@ inline void aligned_free(void *p)
 
 #endif
 
+
+// The size of huge pages, which huge_page_allocator uses
+// for requests of at least this size (on Linux).
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+namespace details {
+
+#if defined(__linux__)
+
+// Map nbytes (a multiple of huge_page_size) of memory backed by huge pages.
+// It first tries explicit huge pages (which are only available if some
+// have been reserved by the system), then maps normal pages aligned to the
+// huge page size, which the kernel can back with transparent huge pages.
+inline void* huge_page_alloc(size_t nbytes) {
+#ifdef MAP_HUGETLB
+    void *p = ::mmap(nullptr, nbytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) return p;
+#endif
+    // over-map by one huge page, and trim the ends to align the block
+    size_t len = nbytes + huge_page_size;
+    void *q = ::mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == MAP_FAILED) throw std::bad_alloc();
+
+    char *c = static_cast<char*>(q);
+    std::uintptr_t a = reinterpret_cast<std::uintptr_t>(c);
+    size_t head = (huge_page_size - a % huge_page_size) % huge_page_size;
+    size_t tail = len - head - nbytes;
+    if (head > 0) ::munmap(c, head);
+    if (tail > 0) ::munmap(c + head + nbytes, tail);
+#ifdef MADV_HUGEPAGE
+    ::madvise(c + head, nbytes, MADV_HUGEPAGE);
+#endif
+    return c + head;
+}
+
+inline void huge_page_free(void *p, size_t nbytes) noexcept {
+    ::munmap(p, nbytes);
+}
+
+#endif
+
+} // end namespace details
+
+
+// A stateless allocator for large buffers (e.g. the working sets of
+// numerical code), which reduces TLB misses by backing requests of at
+// least huge_page_size bytes with huge pages (on Linux). Smaller ones
+// come from aligned_alloc. All blocks are aligned to at least Align bytes
+// (e.g. 64 for AVX-512 loads), and large ones to the huge page size.
+//
+template<class T, size_t Align = 64>
+class huge_page_allocator {
+    static_assert(Align > 0 && (Align & (Align - 1)) == 0,
+        "huge_page_allocator: Align must be a power of two.");
+
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    // the actual alignment of small blocks
+    static constexpr size_t alignment =
+        Align < alignof(T) ? alignof(T) :
+        Align < sizeof(void*) ? sizeof(void*) : Align;
+
+    template<class U>
+    struct rebind {
+        typedef huge_page_allocator<U, Align> other;
+    };
+
+    huge_page_allocator() noexcept = default;
+
+    template<class U>
+    huge_page_allocator(const huge_page_allocator<U, Align>&) noexcept {}
+
+    size_type max_size() const noexcept {
+        return (std::numeric_limits<size_type>::max() - huge_page_size) / sizeof(T);
+    }
+
+    // whether a request of n elements is backed by huge pages
+    static bool uses_huge_pages(size_type n) noexcept {
+#if defined(__linux__)
+        return n * sizeof(T) >= huge_page_size;
+#else
+        return false;
+#endif
+    }
+
+    T* allocate(size_type n) {
+        if (n > max_size()) throw std::bad_alloc();
+        size_t nb = n * sizeof(T);
+#if defined(__linux__)
+        if (uses_huge_pages(n)) {
+            return static_cast<T*>(details::huge_page_alloc(round_up_(nb)));
+        }
+#endif
+        return static_cast<T*>(aligned_alloc(nb > 0 ? nb : 1, alignment));
+    }
+
+    void deallocate(T* p, size_type n) noexcept {
+#if defined(__linux__)
+        if (uses_huge_pages(n)) {
+            details::huge_page_free(p, round_up_(n * sizeof(T)));
+            return;
+        }
+#endif
+        aligned_free(p);
+    }
+
+private:
+    static size_t round_up_(size_t nb) noexcept {
+        return (nb + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+};
+
+template<class T, size_t Align>
+constexpr size_t huge_page_allocator<T, Align>::alignment;
+
+template<class T, class U, size_t A>
+inline bool operator==(const huge_page_allocator<T, A>&, const huge_page_allocator<U, A>&) noexcept {
+    return true;
+}
+
+template<class T, class U, size_t A>
+inline bool operator!=(const huge_page_allocator<T, A>&, const huge_page_allocator<U, A>&) noexcept {
+    return false;
+}
+
+
+// A monotonic arena, which hands out memory from a list of chunks by
+// bumping a pointer. Deallocation does nothing: the memory is reclaimed
+// all at once by reset() or upon destruction. This suits containers that
+// are built up, used, and then thrown away together (e.g. per request or
+// per frame), where it saves the cost of individual frees.
+//
+// Chunks are obtained from operator new, with the size doubling from
+// the initial chunk size up to max_chunk_size. A request larger than the
+// next chunk gets a chunk of its own. The chunks are kept across resets
+// (and reused in order), so that a workload that is repeated after each
+// reset does not acquire any memory once the arena has grown to its peak.
+// An arena is not thread-safe.
+//
+class monotonic_arena {
+private:
+    struct chunk_t {
+        chunk_t *prev;
+        size_t size;    // including the header
+    };
+
+    static constexpr size_t max_align = alignof(std::max_align_t);
+    static constexpr size_t header_size =
+        (sizeof(chunk_t) + max_align - 1) / max_align * max_align;
+
+    size_t chunk_size_;  // the size of the next chunk
+    chunk_t *head_;      // the current chunk (linked to the earlier ones)
+    chunk_t *free_;      // the chunks to reuse, from the oldest
+    char *cur_;
+    char *end_;
+    size_t nused_;
+    size_t nreserved_;
+    size_t nchunks_;
+
+public:
+    static constexpr size_t default_chunk_size = 4096;
+    static constexpr size_t max_chunk_size = size_t(1) << 24;
+
+    // No memory is acquired until the first allocation.
+    explicit monotonic_arena(size_t chunk_size = default_chunk_size) noexcept
+        : chunk_size_(chunk_size > header_size ? chunk_size : header_size * 2)
+        , head_(nullptr), free_(nullptr), cur_(nullptr), end_(nullptr)
+        , nused_(0), nreserved_(0), nchunks_(0) {}
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+    ~monotonic_arena() {
+        release();
+    }
+
+    // Allocate n bytes, aligned to align (which must be a power of two).
+    void* allocate(size_t n, size_t align = max_align) {
+        CLUE_ASSERT(align > 0 && (align & (align - 1)) == 0);
+        char *p = align_up_(cur_, align);
+        if (!cur_ || p > end_ || static_cast<size_t>(end_ - p) < n) {
+            p = new_chunk_(n, align);
+        }
+        cur_ = p + n;
+        nused_ += n;
+        return p;
+    }
+
+    void deallocate(void*, size_t) noexcept {}
+
+    // Make all memory available again, keeping the chunks for reuse.
+    // All memory handed out so far becomes invalid.
+    void reset() noexcept {
+        // pushing from the newest makes the oldest the first to reuse
+        while (head_) {
+            chunk_t *c = head_;
+            head_ = c->prev;
+            c->prev = free_;
+            free_ = c;
+        }
+        cur_ = end_ = nullptr;
+        nused_ = 0;
+    }
+
+    // Release all chunks to the system.
+    void release() noexcept {
+        reset();
+        while (free_) {
+            chunk_t *c = free_;
+            free_ = c->prev;
+            ::operator delete(c);
+        }
+        nreserved_ = nchunks_ = 0;
+    }
+
+    // the number of bytes handed out since the last reset
+    size_t bytes_used() const noexcept {
+        return nused_;
+    }
+
+    // the total size of the chunks held by the arena
+    size_t bytes_reserved() const noexcept {
+        return nreserved_;
+    }
+
+    size_t num_chunks() const noexcept {
+        return nchunks_;
+    }
+
+private:
+    static char* align_up_(char *p, size_t align) noexcept {
+        std::uintptr_t a = reinterpret_cast<std::uintptr_t>(p);
+        return p + ((align - (a & (align - 1))) & (align - 1));
+    }
+
+    char* new_chunk_(size_t n, size_t align) {
+        if (n > std::numeric_limits<size_t>::max() - header_size - align) {
+            throw std::bad_alloc();
+        }
+        size_t need = header_size + n + (align > max_align ? align : 0);
+
+        // reuse the oldest free chunk that can hold the request, and
+        // keep the smaller ones for later requests
+        chunk_t *c = nullptr;
+        for (chunk_t **pf = &free_; *pf; pf = &(*pf)->prev) {
+            if ((*pf)->size >= need) {
+                c = *pf;
+                *pf = c->prev;
+                break;
+            }
+        }
+
+        if (!c) {
+            size_t sz = chunk_size_;
+            if (sz < need) {
+                sz = need;
+            } else if (chunk_size_ < max_chunk_size) {
+                chunk_size_ *= 2;
+            }
+            c = static_cast<chunk_t*>(::operator new(sz));
+            c->size = sz;
+            nreserved_ += sz;
+            ++nchunks_;
+        }
+
+        c->prev = head_;
+        head_ = c;
+        cur_ = reinterpret_cast<char*>(c) + header_size;
+        end_ = reinterpret_cast<char*>(c) + c->size;
+        return align_up_(cur_, align);
+    }
+};
+
+
+// A standard allocator that draws from a monotonic_arena, which must
+// outlive all containers using it. Copies (including rebound ones) share
+// the arena, and they propagate with the containers, so that moved or
+// swapped containers keep drawing from the arena they were built from.
+//
+template<class T>
+class arena_allocator {
+private:
+    monotonic_arena *arena_;
+
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template<class U>
+    struct rebind {
+        typedef arena_allocator<U> other;
+    };
+
+    arena_allocator(monotonic_arena& arena) noexcept
+        : arena_(&arena) {}
+
+    template<class U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+        : arena_(&other.arena()) {}
+
+    monotonic_arena& arena() const noexcept {
+        return *arena_;
+    }
+
+    size_type max_size() const noexcept {
+        return std::numeric_limits<size_type>::max() / sizeof(T);
+    }
+
+    T* allocate(size_type n) {
+        if (n > max_size()) throw std::bad_alloc();
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_type) noexcept {}
+};
+
+template<class T, class U>
+inline bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept {
+    return &a.arena() == &b.arena();
+}
+
+template<class T, class U>
+inline bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) noexcept {
+    return !(a == b);
+}
+
 }
 
 #endif
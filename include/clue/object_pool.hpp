@@ -0,0 +1,333 @@
+/**
+ * @file object_pool.hpp
+ *
+ * A size-class pool of small memory blocks with thread-local caches,
+ * and a standard allocator on top of it.
+ */
+
+#ifndef CLUE_OBJECT_POOL__
+#define CLUE_OBJECT_POOL__
+
+#include <clue/common.hpp>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <limits>
+#include <cstddef>
+
+namespace clue {
+
+// The process-wide pool of small blocks, for allocating many nodes of
+// the same size (e.g. those of node-based containers, or task records).
+//
+// Requests are rounded up to size classes (multiples of granularity, up
+// to max_block_size), and larger ones go to operator new. Each thread
+// keeps a free list per class, from which it allocates, and to which it
+// frees, without any synchronization. A cache that runs dry takes a batch
+// of blocks from the global depot of the class, and one that holds more
+// than two batches returns a batch, so that blocks freed by one thread
+// (e.g. a consumer) flow back to the threads that allocate them (e.g. a
+// producer). A thread returns all its cached blocks upon exit.
+//
+// The depot carves new blocks out of slabs obtained from operator new.
+// Slabs are never released, so the memory held by the pool is bounded by
+// the peak number of live blocks (plus what the caches hold).
+//
+class object_pool {
+public:
+    static constexpr size_t granularity = 16;
+    static constexpr size_t num_classes = 16;
+    static constexpr size_t max_block_size = granularity * num_classes;
+    static constexpr size_t batch_size = 32;
+    static constexpr size_t slab_size = 64 * 1024;
+
+private:
+    // the link to the next batch is only used in the first block
+    // of a batch in the depot
+    struct block_t {
+        block_t *next;
+        block_t *next_batch;
+    };
+    static_assert(sizeof(block_t) <= granularity,
+        "object_pool: a block must fit in the smallest class.");
+
+    // The depot keeps full batches in a stack linked through their first
+    // blocks, and the remaining blocks in a loose list, so that returning
+    // blocks never allocates memory.
+    struct depot_t {
+        std::mutex mut;
+        block_t *batches = nullptr;
+        block_t *loose = nullptr;
+        size_t nloose = 0;
+        size_t nblocks = 0;
+    };
+
+    // Trivially destructible, so that it remains usable while (and after)
+    // the thread-local destructors run; cache_guard_t drains it on exit.
+    struct cache_t {
+        block_t *head[num_classes];
+        size_t n[num_classes];
+        bool registered;
+        bool dead;
+    };
+
+    struct cache_guard_t {
+        ~cache_guard_t() {
+            cache_t& tc = raw_cache_();
+            instance().drain_(tc);
+            tc.dead = true;
+        }
+    };
+
+    depot_t depots_[num_classes];
+    std::atomic<size_t> nslabs_;
+
+public:
+    // The pool is never destroyed, so that blocks can still be freed by
+    // static destructors, and by threads that exit after main returns.
+    static object_pool& instance() {
+        static object_pool *p = new object_pool();
+        return *p;
+    }
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    // the size class of a request of n bytes (n <= max_block_size)
+    static size_t size_class(size_t n) noexcept {
+        return n > 0 ? (n - 1) / granularity : 0;
+    }
+
+    // whether a request of n bytes with the given alignment is served
+    // from the pool (rather than by operator new)
+    static bool is_pooled(size_t n, size_t align) noexcept {
+        return n <= max_block_size &&
+            align <= granularity && align <= alignof(std::max_align_t);
+    }
+
+    // Allocate n bytes (aligned as operator new does, up to granularity).
+    void* allocate(size_t n) {
+        if (n > max_block_size) return ::operator new(n);
+        size_t c = size_class(n);
+        cache_t& tc = cache_();
+        if (!tc.head[c]) refill_(tc, c);
+        block_t *b = tc.head[c];
+        tc.head[c] = b->next;
+        tc.n[c] --;
+        if (tc.dead) drain_(tc);
+        return b;
+    }
+
+    // Free a block of n bytes, where n is the size it was allocated with.
+    void deallocate(void *p, size_t n) noexcept {
+        if (!p) return;
+        if (n > max_block_size) {
+            ::operator delete(p);
+            return;
+        }
+        size_t c = size_class(n);
+        cache_t& tc = cache_();
+        block_t *b = static_cast<block_t*>(p);
+        b->next = tc.head[c];
+        tc.head[c] = b;
+        if (++tc.n[c] > 2 * batch_size) flush_(tc, c);
+        if (tc.dead) drain_(tc);
+    }
+
+    // the number of slabs obtained so far
+    size_t num_slabs() const noexcept {
+        return nslabs_.load(std::memory_order_relaxed);
+    }
+
+    // the number of blocks in the depot, for the class of n bytes
+    size_t depot_size(size_t n) {
+        depot_t& d = depots_[size_class(n)];
+        std::lock_guard<std::mutex> lk(d.mut);
+        return d.nblocks;
+    }
+
+    // the number of blocks cached by the calling thread,
+    // for the class of n bytes
+    size_t cached(size_t n) {
+        return cache_().n[size_class(n)];
+    }
+
+private:
+    object_pool()
+        : nslabs_(0) {}
+
+    static cache_t& raw_cache_() noexcept {
+        static thread_local cache_t tc;
+        return tc;
+    }
+
+    cache_t& cache_() {
+        cache_t& tc = raw_cache_();
+        if (!tc.registered) {
+            tc.registered = true;
+            static thread_local cache_guard_t g;
+            (void)g;
+        }
+        return tc;
+    }
+
+    // get a batch from the depot (or a new slab) into an empty cache
+    void refill_(cache_t& tc, size_t c) {
+        depot_t& d = depots_[c];
+        {
+            std::lock_guard<std::mutex> lk(d.mut);
+            if (d.batches) {
+                block_t *h = d.batches;
+                d.batches = h->next_batch;
+                d.nblocks -= batch_size;
+                tc.head[c] = h;
+                tc.n[c] = batch_size;
+                return;
+            }
+            if (d.loose) {
+                size_t m = d.nloose < batch_size ? d.nloose : batch_size;
+                block_t *h = d.loose;
+                block_t *t = h;
+                for (size_t k = 1; k < m; ++k) t = t->next;
+                d.loose = t->next;
+                d.nloose -= m;
+                d.nblocks -= m;
+                t->next = nullptr;
+                tc.head[c] = h;
+                tc.n[c] = m;
+                return;
+            }
+        }
+
+        // carve a new slab: the first batch goes to the cache,
+        // and the others to the depot
+        size_t bs = (c + 1) * granularity;
+        size_t nb = slab_size / bs;
+        char *s = static_cast<char*>(::operator new(slab_size));
+        nslabs_.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i + 1 < nb; ++i) {
+            reinterpret_cast<block_t*>(s + i * bs)->next =
+                reinterpret_cast<block_t*>(s + (i + 1) * bs);
+        }
+        reinterpret_cast<block_t*>(s + (nb - 1) * bs)->next = nullptr;
+
+        size_t m = nb < batch_size ? nb : batch_size;
+        block_t *h = reinterpret_cast<block_t*>(s);
+        block_t *t = reinterpret_cast<block_t*>(s + (m - 1) * bs);
+        block_t *rest = t->next;
+        t->next = nullptr;
+        tc.head[c] = h;
+        tc.n[c] = m;
+        push_list_(c, rest, nb - m);
+    }
+
+    // return a batch of blocks from a cache to the depot
+    void flush_(cache_t& tc, size_t c) noexcept {
+        block_t *h = tc.head[c];
+        block_t *t = h;
+        for (size_t k = 1; k < batch_size; ++k) t = t->next;
+        tc.head[c] = t->next;
+        tc.n[c] -= batch_size;
+        t->next = nullptr;
+        push_list_(c, h, batch_size);
+    }
+
+    // return all blocks of a cache to the depot
+    void drain_(cache_t& tc) noexcept {
+        for (size_t c = 0; c < num_classes; ++c) {
+            if (tc.head[c]) {
+                push_list_(c, tc.head[c], tc.n[c]);
+                tc.head[c] = nullptr;
+                tc.n[c] = 0;
+            }
+        }
+    }
+
+    // push a list of n blocks to the depot, as full batches,
+    // and the remaining blocks to the loose list
+    void push_list_(size_t c, block_t *h, size_t n) noexcept {
+        if (n == 0) return;
+        depot_t& d = depots_[c];
+        std::lock_guard<std::mutex> lk(d.mut);
+        d.nblocks += n;
+        while (n >= batch_size) {
+            block_t *t = h;
+            for (size_t k = 1; k < batch_size; ++k) t = t->next;
+            block_t *next = t->next;
+            t->next = nullptr;
+            h->next_batch = d.batches;
+            d.batches = h;
+            h = next;
+            n -= batch_size;
+        }
+        if (n > 0) {
+            block_t *t = h;
+            while (t->next) t = t->next;
+            t->next = d.loose;
+            d.loose = h;
+            d.nloose += n;
+        }
+    }
+};
+
+
+// A stateless standard allocator that draws from the object_pool.
+// Requests that fit a size class (e.g. the nodes of node-based containers)
+// are pooled, and the others go to operator new. All instances compare
+// equal, so memory allocated on one thread can be freed on another.
+//
+template<class T>
+class pool_allocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template<class U>
+    struct rebind {
+        typedef pool_allocator<U> other;
+    };
+
+    pool_allocator() noexcept = default;
+
+    template<class U>
+    pool_allocator(const pool_allocator<U>&) noexcept {}
+
+    size_type max_size() const noexcept {
+        return std::numeric_limits<size_type>::max() / sizeof(T);
+    }
+
+    T* allocate(size_type n) {
+        if (n > max_size()) throw std::bad_alloc();
+        if (object_pool::is_pooled(n * sizeof(T), alignof(T))) {
+            return static_cast<T*>(object_pool::instance().allocate(n * sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_type n) noexcept {
+        if (object_pool::is_pooled(n * sizeof(T), alignof(T))) {
+            object_pool::instance().deallocate(p, n * sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+
+template<class T, class U>
+inline bool operator==(const pool_allocator<T>&, const pool_allocator<U>&) noexcept {
+    return true;
+}
+
+template<class T, class U>
+inline bool operator!=(const pool_allocator<T>&, const pool_allocator<U>&) noexcept {
+    return false;
+}
+
+}
+
+#endif
@@ -53,6 +53,10 @@ private:
 public:
     ordered_dict() = default;
 
+    explicit ordered_dict(const Allocator& alloc)
+        : vec_(alloc)
+        , map_(map_allocator(alloc)) {}
+
     template<class InputIter>
     ordered_dict(InputIter first, InputIter last) {
         insert(first, last);
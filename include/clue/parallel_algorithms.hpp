@@ -0,0 +1,290 @@
+/**
+ * @file parallel_algorithms.hpp
+ *
+ * Parallel versions of common algorithms, on top of thread_pool.
+ */
+
+#ifndef CLUE_PARALLEL_ALGORITHMS__
+#define CLUE_PARALLEL_ALGORITHMS__
+
+#include <clue/thread_pool.hpp>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+namespace clue {
+
+namespace details {
+
+// the grain size used when it is not specified (0): about 8 chunks
+// per thread, so that threads that get cheap chunks take more of them
+inline size_t par_grain(const thread_pool& pool, size_t n, size_t grain) {
+    if (grain > 0) return grain;
+    size_t nthreads = pool.concurrency();
+    size_t g = n / (8 * (nthreads > 0 ? nthreads : 1));
+    return g > 0 ? g : 1;
+}
+
+// Call f(b, e) for each chunk [b, e) of [0, n) of the grain size, and
+// block until all chunks are processed. Chunks are claimed one at a time
+// by the runners of a bulk (see thread_pool::schedule_bulk), so the work
+// is balanced dynamically when chunks take uneven time.
+template<class F>
+void par_chunks(thread_pool& pool, size_t n, size_t g, F&& f) {
+    if (n == 0) return;
+    size_t nc = (n + g - 1) / g;
+    if (nc == 1) {
+        f(size_t(0), n);
+        return;
+    }
+    pool.schedule_bulk(size_t(0), nc, [n, g, &f](size_t, size_t c){
+        size_t b = c * g;
+        f(b, b + g < n ? b + g : n);
+    }, 1).wait();
+}
+
+template<class Range>
+using range_iterator_t = decltype(std::begin(std::declval<Range&>()));
+
+template<class Range>
+using range_value_t = typename std::decay<
+    typename std::iterator_traits<range_iterator_t<Range>>::value_type>::type;
+
+template<class Range>
+inline size_t range_size(Range& rng) {
+    return static_cast<size_t>(std::distance(std::begin(rng), std::end(rng)));
+}
+
+// The number of elements of a that precede the first d elements of
+// the (stable) merge of a[0:m) and b[0:n), found by binary search
+// along the d-th diagonal of the merge path.
+template<class It1, class It2, class Comp>
+size_t merge_path(It1 a, size_t m, It2 b, size_t n, size_t d, Comp& comp) {
+    size_t lo = d > n ? d - n : 0;
+    size_t hi = d < m ? d : m;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (comp(b[d - mid - 1], a[mid])) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+// The piece [b, e) of the output of merging adjacent sorted runs of
+// width w in src. Its split points (along the merge path) must all be
+// found before any piece is merged, as merging moves the elements out.
+struct merge_piece_t {
+    size_t s;       // start of the pair of runs
+    size_t am;      // end of the first run (start of the second)
+    size_t bm;      // end of the second run
+    size_t i0, i1;  // [i0, i1) of the first run go to the piece
+
+    template<class It, class Comp>
+    void find(It src, size_t n, size_t w, size_t b, size_t e, Comp& comp) {
+        s = (b / (2 * w)) * (2 * w);
+        am = s + w < n ? s + w : n;
+        bm = s + 2 * w < n ? s + 2 * w : n;
+        i0 = merge_path(src + s, am - s, src + am, bm - am, b - s, comp);
+        i1 = merge_path(src + s, am - s, src + am, bm - am, e - s, comp);
+    }
+
+    template<class It1, class It2, class Comp>
+    void merge(It1 src, It2 dst, size_t b, size_t e, Comp& comp) const {
+        size_t j0 = (b - s) - i0;
+        size_t j1 = (e - s) - i1;
+        std::merge(std::make_move_iterator(src + s + i0),
+                   std::make_move_iterator(src + s + i1),
+                   std::make_move_iterator(src + am + j0),
+                   std::make_move_iterator(src + am + j1),
+                   dst + b, comp);
+    }
+};
+
+// merge adjacent sorted runs of width w in src to dst,
+// in pieces of size g
+template<class It1, class It2, class Comp>
+void merge_runs(thread_pool& pool, It1 src, It2 dst,
+                size_t n, size_t w, size_t g, Comp& comp) {
+    size_t np = (n + g - 1) / g;
+    std::vector<merge_piece_t> pieces(np);
+    par_chunks(pool, np, par_grain(pool, np, 0), [&](size_t pb, size_t pe){
+        for (size_t p = pb; p < pe; ++p) {
+            size_t b = p * g;
+            pieces[p].find(src, n, w, b, b + g < n ? b + g : n, comp);
+        }
+    });
+    par_chunks(pool, n, g, [&](size_t b, size_t e){
+        pieces[b / g].merge(src, dst, b, e, comp);
+    });
+}
+
+} // end namespace details
+
+
+// Apply f(x) to each element x of a random-access range
+// (e.g. value_range, array_view, fast_vector, std::vector).
+//
+// Note: these algorithms block the calling thread until they finish,
+// so they should not be called from a task running on the same pool.
+//
+template<class Range, class F>
+void parallel_for_each(thread_pool& pool, Range&& rng, F&& f, size_t grain=0) {
+    auto first = std::begin(rng);
+    size_t n = details::range_size(rng);
+    details::par_chunks(pool, n, details::par_grain(pool, n, grain),
+        [first, &f](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) f(first[i]);
+        });
+}
+
+// Write f(x) for each element x of rng to the range beginning at out
+// (a random-access iterator), and return the end of the output.
+template<class Range, class OutIter, class F>
+OutIter parallel_transform(thread_pool& pool, Range&& rng, OutIter out,
+                           F&& f, size_t grain=0) {
+    auto first = std::begin(rng);
+    size_t n = details::range_size(rng);
+    details::par_chunks(pool, n, details::par_grain(pool, n, grain),
+        [first, out, &f](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) out[i] = f(first[i]);
+        });
+    return out + n;
+}
+
+// Reduce the elements of rng with op, starting from init.
+//
+// op must be associative (but need not be commutative): chunks are
+// reduced in parallel, and the partial results are combined in order.
+template<class Range, class T, class Op,
+         CLUE_REQUIRE(!std::is_integral<Op>::value)>
+T parallel_reduce(thread_pool& pool, Range&& rng, T init, Op op, size_t grain=0) {
+    auto first = std::begin(rng);
+    size_t n = details::range_size(rng);
+    size_t g = details::par_grain(pool, n, grain);
+    size_t nc = (n + g - 1) / g;
+
+    std::vector<T> partials(nc, init);
+    details::par_chunks(pool, n, g, [first, g, &op, &partials](size_t b, size_t e){
+        T a = first[b];
+        for (size_t i = b + 1; i < e; ++i) a = op(a, first[i]);
+        partials[b / g] = std::move(a);
+    });
+
+    T r = std::move(init);
+    for (size_t c = 0; c < nc; ++c) r = op(r, partials[c]);
+    return r;
+}
+
+template<class Range, class T>
+T parallel_reduce(thread_pool& pool, Range&& rng, T init, size_t grain=0) {
+    return parallel_reduce(pool, std::forward<Range>(rng),
+                           std::move(init), std::plus<T>(), grain);
+}
+
+// Write the inclusive prefix scan of rng with op to the range beginning
+// at out (a random-access iterator, which may be the beginning of rng),
+// and return the end of the output.
+//
+// It makes two passes: chunk totals are computed in parallel and scanned
+// sequentially, then each chunk is scanned from the total of the chunks
+// before it. op must be associative.
+template<class Range, class OutIter, class Op,
+         CLUE_REQUIRE(!std::is_integral<Op>::value)>
+OutIter parallel_scan(thread_pool& pool, Range&& rng, OutIter out,
+                      Op op, size_t grain=0) {
+    using T = details::range_value_t<Range>;
+    auto first = std::begin(rng);
+    size_t n = details::range_size(rng);
+    size_t g = details::par_grain(pool, n, grain);
+    size_t nc = (n + g - 1) / g;
+    if (nc <= 1) {
+        if (n > 0) std::partial_sum(first, first + n, out, op);
+        return out + n;
+    }
+
+    // pass 1: the total of each chunk (but the last)
+    std::vector<T> sums;
+    sums.reserve(nc - 1);
+    for (size_t c = 0; c + 1 < nc; ++c) sums.push_back(first[c * g]);
+    details::par_chunks(pool, (nc - 1) * g, g, [first, g, &op, &sums](size_t b, size_t e){
+        T a = first[b];
+        for (size_t i = b + 1; i < e; ++i) a = op(a, first[i]);
+        sums[b / g] = std::move(a);
+    });
+    for (size_t c = 1; c + 1 < nc; ++c) sums[c] = op(sums[c - 1], sums[c]);
+
+    // pass 2: scan each chunk from the total of the preceding ones
+    details::par_chunks(pool, n, g, [first, out, g, &op, &sums](size_t b, size_t e){
+        T a = b == 0 ? T(first[0]) : op(sums[b / g - 1], first[b]);
+        out[b] = a;
+        for (size_t i = b + 1; i < e; ++i) {
+            a = op(a, first[i]);
+            out[i] = a;
+        }
+    });
+    return out + n;
+}
+
+template<class Range, class OutIter>
+OutIter parallel_scan(thread_pool& pool, Range&& rng, OutIter out, size_t grain=0) {
+    using T = details::range_value_t<Range>;
+    return parallel_scan(pool, std::forward<Range>(rng), out, std::plus<T>(), grain);
+}
+
+// Sort a mutable random-access range (e.g. array_view, fast_vector,
+// std::vector) with comp, by a parallel merge sort. The sort is not
+// stable, and the element type must be default constructible.
+//
+// Runs of the grain size are sorted in parallel, then pairs of runs are
+// merged level by level. Every merge is split into pieces of the grain
+// size along its merge path, so that all threads remain busy at the
+// top levels, where only a few long runs are left.
+template<class Range, class Comp,
+         CLUE_REQUIRE(!std::is_integral<Comp>::value)>
+void parallel_sort(thread_pool& pool, Range&& rng, Comp comp, size_t grain=0) {
+    using T = details::range_value_t<Range>;
+    auto first = std::begin(rng);
+    size_t n = details::range_size(rng);
+    size_t g = details::par_grain(pool, n, grain);
+    if (n <= g) {
+        std::sort(first, first + n, comp);
+        return;
+    }
+
+    details::par_chunks(pool, n, g, [first, &comp](size_t b, size_t e){
+        std::sort(first + b, first + e, comp);
+    });
+
+    std::vector<T> buf(n);
+    auto bfirst = buf.begin();
+    bool in_buf = false;   // whether the current runs are in buf
+    for (size_t w = g; w < n; w *= 2) {
+        if (in_buf) {
+            details::merge_runs(pool, bfirst, first, n, w, g, comp);
+        } else {
+            details::merge_runs(pool, first, bfirst, n, w, g, comp);
+        }
+        in_buf = !in_buf;
+    }
+
+    if (in_buf) {
+        details::par_chunks(pool, n, g, [first, bfirst](size_t b, size_t e){
+            std::move(bfirst + b, bfirst + e, first + b);
+        });
+    }
+}
+
+template<class Range>
+void parallel_sort(thread_pool& pool, Range&& rng, size_t grain=0) {
+    using T = details::range_value_t<Range>;
+    parallel_sort(pool, std::forward<Range>(rng), std::less<T>(), grain);
+}
+
+}
+
+#endif
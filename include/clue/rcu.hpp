@@ -0,0 +1,336 @@
+/**
+ * @file rcu.hpp
+ *
+ * Read-copy-update (RCU) style holders for read-mostly data,
+ * with epoch-based reclamation of old versions.
+ */
+
+#ifndef CLUE_RCU__
+#define CLUE_RCU__
+
+#include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#include <clue/thread_slots.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+namespace clue {
+
+// An epoch-based reclamation domain.
+//
+// A reader enters a read-side critical section by incrementing a counter
+// in its own cache-line-padded slot (slots are assigned to threads in a
+// round-robin manner), in one of two banks chosen by the parity of the
+// current epoch. Entering and leaving are wait-free, and never write to
+// a cache line shared with readers on other cores.
+//
+// The epoch can only advance from E to E+1 when the bank of E-1 (i.e.
+// that of E+1) has no readers. Hence, when the epoch reaches R+2, both
+// banks have been drained since epoch R, and no reader can still hold
+// anything that had been unlinked when the epoch was R.
+//
+// Advances (a scan of a bank, then the increment) are serialized by a
+// mutex, and R is read under it: otherwise, an advance whose scan began
+// before an object was unlinked could complete after R is read, and count
+// as one of the two advances without having seen a reader of the object.
+//
+class rcu_domain {
+private:
+    // a counter for each of the two banks
+    typedef details::padded_slot<std::atomic<long>[2]> slot_t;
+
+    size_t mask_;
+    std::unique_ptr<slot_t[]> slots_;
+    std::atomic<uint64_t> epoch_;   // only modified under adv_mut_
+    std::mutex adv_mut_;
+
+public:
+    // A read-side critical section, which ends when the guard is
+    // destroyed or released. It is movable (and may be released
+    // on another thread than the one it was created on).
+    class read_guard {
+    private:
+        std::atomic<long> *c_;
+
+    public:
+        read_guard() noexcept
+            : c_(nullptr) {}
+
+        explicit read_guard(std::atomic<long> *c) noexcept
+            : c_(c) {}
+
+        read_guard(read_guard&& other) noexcept
+            : c_(other.c_) {
+            other.c_ = nullptr;
+        }
+
+        read_guard& operator=(read_guard&& other) noexcept {
+            if (this != &other) {
+                release();
+                c_ = other.c_;
+                other.c_ = nullptr;
+            }
+            return *this;
+        }
+
+        read_guard(const read_guard&) = delete;
+        read_guard& operator=(const read_guard&) = delete;
+
+        ~read_guard() {
+            release();
+        }
+
+        bool owns() const noexcept {
+            return c_ != nullptr;
+        }
+
+        void release() noexcept {
+            if (c_) {
+                c_->fetch_sub(1);
+                c_ = nullptr;
+            }
+        }
+    };
+
+    // The number of slots is rounded up to a power of two.
+    // By default, it is the number of hardware threads.
+    explicit rcu_domain(size_t nslots = 0)
+        : mask_(details::round_slots(nslots) - 1)
+        , slots_(new slot_t[mask_ + 1])
+        , epoch_(0) {}
+
+    rcu_domain(const rcu_domain&) = delete;
+    rcu_domain& operator=(const rcu_domain&) = delete;
+
+    size_t num_slots() const noexcept {
+        return mask_ + 1;
+    }
+
+    uint64_t epoch() const noexcept {
+        return epoch_.load();
+    }
+
+    // Enter a read-side critical section (wait-free). The counter update
+    // and the scan of the writer form a Dekker-style handshake (see
+    // details::notify_parked).
+    read_guard read_lock() noexcept {
+        unsigned b = static_cast<unsigned>(epoch_.load() & 1);
+        std::atomic<long> *c = &(slots_[details::thread_slot_index() & mask_].v[b]);
+        c->fetch_add(1);
+        return read_guard(c);
+    }
+
+    // The epoch to record for objects unlinked before the call. They can
+    // be deleted once epoch() >= retire_epoch() + 2.
+    uint64_t retire_epoch() {
+        std::lock_guard<std::mutex> lk(adv_mut_);
+        return epoch_.load();
+    }
+
+    // Advance the epoch towards target, as far as possible without waiting
+    // for readers. Return whether the epoch has reached target.
+    bool poll(uint64_t target) {
+        std::lock_guard<std::mutex> lk(adv_mut_);
+        while (epoch_.load() < target && try_advance_locked_()) {}
+        return epoch_.load() >= target;
+    }
+
+    // Block until all readers that entered before the call have left.
+    // It must not be called within a read-side critical section.
+    void synchronize() {
+        uint64_t target = retire_epoch() + 2;
+        spin_wait sw;
+        while (!poll(target)) {
+            if (!sw.spin_once()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+private:
+    // advance the epoch by one if no readers remain in the bank of
+    // the previous epoch (under adv_mut_)
+    bool try_advance_locked_() noexcept {
+        uint64_t e = epoch_.load();
+        if (readers_(static_cast<unsigned>((e + 1) & 1)) != 0) return false;
+        epoch_.store(e + 1);
+        return true;
+    }
+
+    // A reader always leaves through the counter it entered on, so
+    // no slot goes negative, and the sum is zero only if none of the
+    // readers seen entering is still inside.
+    long readers_(unsigned b) const noexcept {
+        long r = 0;
+        for (size_t i = 0; i <= mask_; ++i) r += slots_[i].v[b].load();
+        return r;
+    }
+};
+
+
+// A holder of an immutable value of type T, for data that is read very
+// often and updated rarely (e.g. configurations or routing tables).
+//
+// Readers take a snapshot (wait-free), which keeps the version it refers
+// to alive. Writers (serialized by a mutex) publish a new version, and
+// retire the old one, which is deleted once no reader can hold it. The
+// retired versions are reclaimed (without blocking) on later updates, or
+// all at once (blocking) by synchronize().
+//
+template<class T>
+class rcu_cell {
+public:
+    typedef T value_type;
+
+    class snapshot {
+    private:
+        rcu_domain::read_guard g_;
+        const T *p_;
+
+    public:
+        snapshot() noexcept
+            : p_(nullptr) {}
+
+        snapshot(rcu_domain::read_guard&& g, const T *p) noexcept
+            : g_(std::move(g)), p_(p) {}
+
+        snapshot(snapshot&& other) noexcept
+            : g_(std::move(other.g_)), p_(other.p_) {
+            other.p_ = nullptr;
+        }
+
+        snapshot& operator=(snapshot&& other) noexcept {
+            g_ = std::move(other.g_);
+            p_ = other.p_;
+            other.p_ = nullptr;
+            return *this;
+        }
+
+        const T* get() const noexcept { return p_; }
+        const T& operator*() const noexcept { return *p_; }
+        const T* operator->() const noexcept { return p_; }
+
+        explicit operator bool() const noexcept {
+            return p_ != nullptr;
+        }
+
+        // end the read-side critical section (the value
+        // must not be accessed afterwards)
+        void release() noexcept {
+            g_.release();
+            p_ = nullptr;
+        }
+    };
+
+private:
+    struct retired_t {
+        uint64_t epoch;
+        std::unique_ptr<const T> p;
+    };
+
+    mutable rcu_domain dom_;
+    std::atomic<const T*> p_;
+    std::mutex wmut_;
+    std::vector<retired_t> retired_;
+
+public:
+    rcu_cell()
+        : p_(new T()) {}
+
+    explicit rcu_cell(T v, size_t nslots = 0)
+        : dom_(nslots)
+        , p_(new T(std::move(v))) {}
+
+    rcu_cell(const rcu_cell&) = delete;
+    rcu_cell& operator=(const rcu_cell&) = delete;
+
+    // There must be no snapshots left when the cell is destroyed.
+    ~rcu_cell() {
+        delete p_.load();
+    }
+
+    // Take a snapshot of the current version (wait-free).
+    snapshot read() const noexcept {
+        rcu_domain::read_guard g = dom_.read_lock();
+        const T *p = p_.load();
+        return snapshot(std::move(g), p);
+    }
+
+    // Get a copy of the current value.
+    T load() const {
+        return *read();
+    }
+
+    // Publish v as the new version.
+    void store(T v) {
+        publish_(std::unique_ptr<const T>(new T(std::move(v))));
+    }
+
+    template<class... Args>
+    void emplace(Args&&... args) {
+        publish_(std::unique_ptr<const T>(new T(std::forward<Args>(args)...)));
+    }
+
+    // Publish f(cur) as the new version, where cur is the current value.
+    // Concurrent updates are serialized, so none of them is lost.
+    template<class F>
+    void update(F&& f) {
+        std::lock_guard<std::mutex> lk(wmut_);
+        const T *cur = p_.load();
+        std::unique_ptr<const T> np(new T(f(*cur)));
+        publish_locked_(std::move(np));
+    }
+
+    // the number of retired versions that are yet to be deleted
+    size_t num_retired() {
+        std::lock_guard<std::mutex> lk(wmut_);
+        return retired_.size();
+    }
+
+    // Block until all retired versions can be (and have been) deleted.
+    // It must not be called while the calling thread holds a snapshot.
+    void synchronize() {
+        std::lock_guard<std::mutex> lk(wmut_);
+        if (retired_.empty()) return;
+        dom_.synchronize();
+        reclaim_locked_();
+    }
+
+    const rcu_domain& domain() const noexcept {
+        return dom_;
+    }
+
+private:
+    void publish_(std::unique_ptr<const T> np) {
+        std::lock_guard<std::mutex> lk(wmut_);
+        publish_locked_(std::move(np));
+    }
+
+    void publish_locked_(std::unique_ptr<const T> np) {
+        const T *old = p_.exchange(np.release());
+        retired_.push_back(retired_t{dom_.retire_epoch(), std::unique_ptr<const T>(old)});
+        reclaim_locked_();
+    }
+
+    // delete the versions retired at least two epochs ago, after
+    // trying to advance the epoch (without waiting for readers)
+    void reclaim_locked_() {
+        if (retired_.empty()) return;
+        dom_.poll(retired_.back().epoch + 2);
+
+        uint64_t e = dom_.epoch();
+        size_t k = 0;
+        while (k < retired_.size() && retired_[k].epoch + 2 <= e) ++k;
+        retired_.erase(retired_.begin(), retired_.begin() + k);
+    }
+};
+
+}
+
+#endif
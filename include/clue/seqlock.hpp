@@ -0,0 +1,135 @@
+/**
+ * @file seqlock.hpp
+ *
+ * A sequence lock for small trivially copyable records.
+ */
+
+#ifndef CLUE_SEQLOCK__
+#define CLUE_SEQLOCK__
+
+#include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace clue {
+
+// A seqlock holds a copy of a small record of type T, which readers copy
+// out without writing to any shared memory: a reader reads the sequence
+// number, copies the record, and re-reads the sequence number. If the
+// number is odd (a write is in progress) or has changed, it retries.
+// Writers make the number odd, update the record, and make it even again
+// (concurrent writers are serialized on the sequence number itself).
+//
+// The record is stored as an array of atomic words, accessed with
+// acquire/release ordering (which compiles to plain moves on x86), so
+// that torn reads, which are discarded, are not data races either.
+//
+template<class T>
+class seqlock {
+    static_assert(std::is_trivially_copyable<T>::value,
+        "seqlock: T must be trivially copyable.");
+
+private:
+    typedef std::uintptr_t word_t;
+    static constexpr size_t nwords = (sizeof(T) + sizeof(word_t) - 1) / sizeof(word_t);
+
+    std::atomic<unsigned> seq_;
+    std::atomic<word_t> data_[nwords];
+
+public:
+    typedef T value_type;
+
+    seqlock() noexcept
+        : seqlock(T()) {}
+
+    explicit seqlock(const T& v) noexcept
+        : seq_(0) {
+        write_(v);
+    }
+
+    seqlock(const seqlock&) = delete;
+    seqlock& operator=(const seqlock&) = delete;
+
+    // The sequence number, which is odd while a write is in progress,
+    // and increases by two with each completed write.
+    unsigned sequence() const noexcept {
+        return seq_.load(std::memory_order_acquire);
+    }
+
+    // Try to read the record once. It returns false (leaving dst with
+    // unspecified contents) if a write was in progress.
+    bool try_load(T& dst) const noexcept {
+        unsigned s0 = seq_.load(std::memory_order_acquire);
+        if (s0 & 1) return false;
+        read_(dst);
+        return seq_.load(std::memory_order_relaxed) == s0;
+    }
+
+    // Read the record, retrying while it is being written.
+    T load() const noexcept {
+        T v;
+        while (!try_load(v)) cpu_relax();
+        return v;
+    }
+
+    void store(const T& v) noexcept {
+        unsigned s = lock_();
+        write_(v);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+    // Apply f to the record (in place, as a T&) under the writer lock,
+    // so that read-modify-write updates are not lost. f should be short,
+    // as readers spin while it runs, and must not throw.
+    template<class F>
+    void update(F&& f) noexcept {
+        unsigned s = lock_();
+        T v;
+        read_(v);
+        f(v);
+        write_(v);
+        seq_.store(s + 2, std::memory_order_release);
+    }
+
+private:
+    // make the sequence number odd (waiting for other writers),
+    // and return its value before
+    unsigned lock_() noexcept {
+        unsigned s = seq_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!(s & 1) && seq_.compare_exchange_weak(s, s + 1,
+                    std::memory_order_acquire, std::memory_order_relaxed)) {
+                return s;
+            }
+            cpu_relax();
+            s = seq_.load(std::memory_order_relaxed);
+        }
+    }
+
+    // The acquire loads (and release stores) of the words keep them
+    // between the two reads (and writes) of the sequence number: when a
+    // reader sees a word from a write, it must also see the number that
+    // write made odd.
+    void read_(T& dst) const noexcept {
+        word_t buf[nwords];
+        for (size_t i = 0; i < nwords; ++i) {
+            buf[i] = data_[i].load(std::memory_order_acquire);
+        }
+        std::memcpy(&dst, buf, sizeof(T));
+    }
+
+    void write_(const T& v) noexcept {
+        word_t buf[nwords] = {};
+        std::memcpy(buf, &v, sizeof(T));
+        for (size_t i = 0; i < nwords; ++i) {
+            data_[i].store(buf[i], std::memory_order_release);
+        }
+    }
+};
+
+}
+
+#endif
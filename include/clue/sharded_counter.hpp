@@ -0,0 +1,143 @@
+/**
+ * @file sharded_counter.hpp
+ *
+ * A counter that spreads its value over cache-line-padded
+ * slots, so that concurrent increments do not contend.
+ */
+
+#ifndef CLUE_SHARDED_COUNTER__
+#define CLUE_SHARDED_COUNTER__
+
+#include <clue/predicates.hpp>
+#include <clue/thread_slots.hpp>
+#include <clue/spin_wait.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+namespace clue {
+
+class sharded_counter {
+public:
+    typedef long value_type;
+    typedef std::mutex mutex_type;
+
+private:
+    typedef details::padded_slot<std::atomic<value_type>> slot_t;
+
+    size_t mask_;
+    std::unique_ptr<slot_t[]> slots_;
+    std::atomic<size_t> n_waiters_;
+    mutable mutex_type mut_;
+    std::condition_variable cv_;
+
+public:
+    // The number of shards is rounded up to a power of two.
+    // By default, it is the number of hardware threads.
+    explicit sharded_counter(size_t nshards = 0)
+        : mask_(details::round_slots(nshards) - 1)
+        , slots_(new slot_t[mask_ + 1])
+        , n_waiters_(0) {}
+
+    sharded_counter(const sharded_counter&) = delete;
+    sharded_counter& operator=(const sharded_counter&) = delete;
+
+    size_t num_shards() const noexcept {
+        return mask_ + 1;
+    }
+
+    // The sum over all slots. When other threads are updating the
+    // counter, this is the value at no particular moment, but each
+    // completed update is reflected in it.
+    long get() const {
+        long s = 0;
+        for (size_t i = 0; i <= mask_; ++i) s += slots_[i].v.load();
+        return s;
+    }
+
+    void inc(long x = 1) {
+        if (x != 0) {
+            my_slot_().v.fetch_add(x);
+            notify_waiters();
+        }
+    }
+
+    void dec(long x = 1) {
+        if (x != 0) {
+            my_slot_().v.fetch_sub(x);
+            notify_waiters();
+        }
+    }
+
+    // reset all slots to zero (updates that are concurrent
+    // with reset may or may not be retained)
+    void reset() {
+        for (size_t i = 0; i <= mask_; ++i) slots_[i].v.store(0);
+        notify_waiters();
+    }
+
+    // Wait until the aggregated value meets the condition. The value is
+    // re-aggregated every time an update notifies the waiters, so pred
+    // may miss a value that is only transiently held by the counter.
+    template<class Pred>
+    void wait(Pred&& pred) {
+        if (pred(get())) return;
+        std::unique_lock<mutex_type> lk(mut_);
+        n_waiters_ ++;
+        cv_.wait(lk, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
+    }
+
+    template<class Pred, class Rep, class Period>
+    bool wait_for(Pred&& pred, const std::chrono::duration<Rep, Period>& dur) {
+        if (pred(get())) return true;
+        std::unique_lock<mutex_type> lk(mut_);
+        n_waiters_ ++;
+        bool r = cv_.wait_for(lk, dur, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
+        return r;
+    }
+
+    template<class Pred, class Clk, class Dur>
+    bool wait_until(Pred&& pred, const std::chrono::time_point<Clk, Dur>& t) {
+        if (pred(get())) return true;
+        std::unique_lock<mutex_type> lk(mut_);
+        n_waiters_ ++;
+        bool r = cv_.wait_until(lk, t, [this,&pred](){ return pred(get()); });
+        n_waiters_ --;
+        return r;
+    }
+
+    void wait(long v) {
+        wait(eq(v));
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(long v, const std::chrono::duration<Rep, Period>& dur) {
+        return wait_for(eq(v), dur);
+    }
+
+    template<class Clk, class Dur>
+    bool wait_until(long v, const std::chrono::time_point<Clk, Dur>& t) {
+        return wait_until(eq(v), t);
+    }
+
+private:
+    slot_t& my_slot_() {
+        return slots_[details::thread_slot_index() & mask_];
+    }
+
+    // called after each slot update, which is seq_cst (an atomic add
+    // costs the same under any ordering on x86), as details::notify_parked
+    // requires
+    void notify_waiters() {
+        details::notify_parked(n_waiters_, mut_, cv_);
+    }
+};
+
+}
+
+#endif
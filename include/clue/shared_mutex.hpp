@@ -16,6 +16,14 @@
 #define CLUE_SHARED_MUTEX__
 
 #include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#include <clue/thread_slots.hpp>
+#ifdef CLUE_LOCK_PROFILING
+#include <clue/lock_profiler.hpp>
+#endif
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <chrono>
@@ -26,6 +34,7 @@ using std::unique_lock;
 
 namespace details {
 
+template<class WaitPolicy>
 class shared_mutex_impl {
     typedef ::std::mutex mutex_t;
     typedef unsigned int count_t;
@@ -34,6 +43,9 @@ class shared_mutex_impl {
     ::std::condition_variable gate1_;
     ::std::condition_variable gate2_;
     count_t state_;
+#ifdef CLUE_LOCK_PROFILING
+    lock_profile prof_{this};
+#endif
 
     static constexpr count_t write_entered_ = 1U << (sizeof(count_t)*CHAR_BIT - 1);
     static constexpr count_t n_readers_ = ~write_entered_;
@@ -52,22 +64,44 @@ public:
 
     shared_mutex_impl& operator=(const shared_mutex_impl&) = delete;
 
+    void set_name(const char *name) {
+#ifdef CLUE_LOCK_PROFILING
+        prof_.set_name(name);
+#else
+        (void)name;
+#endif
+    }
+
     // exclusive ownership
 
     // locks the mutex, blocks if the mutex is not available
     void lock() {
-        std::unique_lock<mutex_t> lk(mut_);
+#ifdef CLUE_LOCK_PROFILING
+        // started before lock_(), so that the wait
+        // for the internal mutex is counted as well
+        stop_watch sw(true);
+#endif
+        auto lk = lock_();
+#ifdef CLUE_LOCK_PROFILING
+        bool contended = state_ != 0;
+#endif
 
-        while (state_ & write_entered_) gate1_.wait(lk);
+        WaitPolicy::wait(lk, gate1_, [this](){ return !(state_ & write_entered_); });
         state_ |= write_entered_;
-        while (state_ & n_readers_) gate2_.wait(lk);
+        WaitPolicy::wait(lk, gate2_, [this](){ return !(state_ & n_readers_); });
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_acquire(contended, sw);
+#endif
     }
 
     // tries to lock the mutex, returns if the mutex is not available
     bool try_lock() {
-        std::unique_lock<mutex_t> lk(mut_);
+        auto lk = lock_();
         if (state_ == 0) {
             state_ = write_entered_;
+#ifdef CLUE_LOCK_PROFILING
+            prof_.on_acquire(false, stop_watch());
+#endif
             return true;
         }
         return false;
@@ -77,7 +111,15 @@ public:
     // unavailable until specified time point has been reached
     template <class Clock, class Duration>
     bool try_lock_until(const std::chrono::time_point<Clock, Duration>& due_time) {
-        std::unique_lock<mutex_t> lk(mut_);
+#ifdef CLUE_LOCK_PROFILING
+        // started before lock_(), so that the wait
+        // for the internal mutex is counted as well
+        stop_watch sw(true);
+#endif
+        auto lk = lock_();
+#ifdef CLUE_LOCK_PROFILING
+        bool contended = state_ != 0;
+#endif
 
         if (state_ & write_entered_) {
             while (true) {
@@ -102,12 +144,18 @@ public:
             }
         }
 
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_acquire(contended, sw);
+#endif
         return true;
     }
 
     // unlocks the mutex
     void unlock() {
-        std::lock_guard<mutex_t> _(mut_);
+        auto lk = lock_();
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_release();
+#endif
         state_ = 0;
         gate1_.notify_all();
     }
@@ -116,24 +164,38 @@ public:
 
     // locks the mutex for shared ownership, blocks if the mutex is not available
     void lock_shared() {
-        std::unique_lock<mutex_t> lk(mut_);
+#ifdef CLUE_LOCK_PROFILING
+        stop_watch sw(true);
+#endif
+        auto lk = lock_();
+        auto avail = [this](){
+            return !(state_ & write_entered_) && (state_ & n_readers_) != n_readers_;
+        };
+#ifdef CLUE_LOCK_PROFILING
+        bool contended = !avail();
+#endif
 
-        while ((state_ & write_entered_) || (state_ & n_readers_) == n_readers_)
-            gate1_.wait(lk);
+        WaitPolicy::wait(lk, gate1_, avail);
         count_t num_readers = (state_ & n_readers_) + 1;
         state_ &= ~n_readers_;
         state_ |= num_readers;
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_acquire_shared(contended, sw);
+#endif
     }
 
     // tries to lock the mutex for shared ownership, returns if the mutex is not available
     bool try_lock_shared() {
-        std::unique_lock<mutex_t> lk(mut_);
+        auto lk = lock_();
         count_t num_readers = state_ & n_readers_;
         if (!(state_ & write_entered_) && num_readers != n_readers_)
         {
             ++num_readers;
             state_ &= ~n_readers_;
             state_ |= num_readers;
+#ifdef CLUE_LOCK_PROFILING
+            prof_.on_acquire_shared(false, stop_watch());
+#endif
             return true;
         }
         return false;
@@ -143,7 +205,13 @@ public:
     // unavailable until specified time point has been reached
     template <class Clock, class Duration>
     bool try_lock_shared_until(const ::std::chrono::time_point<Clock, Duration>& due_time) {
-        std::unique_lock<mutex_t> lk(mut_);
+#ifdef CLUE_LOCK_PROFILING
+        stop_watch sw(true);
+#endif
+        auto lk = lock_();
+#ifdef CLUE_LOCK_PROFILING
+        bool contended = (state_ & write_entered_) || (state_ & n_readers_) == n_readers_;
+#endif
         if ((state_ & write_entered_) || (state_ & n_readers_) == n_readers_) {
             while (true)
             {
@@ -157,12 +225,15 @@ public:
         count_t num_readers = (state_ & n_readers_) + 1;
         state_ &= ~n_readers_;
         state_ |= num_readers;
+#ifdef CLUE_LOCK_PROFILING
+        prof_.on_acquire_shared(contended, sw);
+#endif
         return true;
     }
 
     // unlocks the mutex (shared ownership)
     void unlock_shared() {
-        std::lock_guard<mutex_t> _(mut_);
+        auto lk = lock_();
         count_t num_readers = (state_ & n_readers_) - 1;
         state_ &= ~n_readers_;
         state_ |= num_readers;
@@ -176,23 +247,39 @@ public:
         }
     }
 
-}; // end class shared_mutex
+private:
+    std::unique_lock<mutex_t> lock_() {
+        WaitPolicy::lock(mut_);
+        return std::unique_lock<mutex_t>(mut_, std::adopt_lock);
+    }
+
+}; // end class shared_mutex_impl
 
 } // end namespace details
 
 
-class shared_mutex {
+// WaitPolicy decides how the threads wait for the mutex (see
+// spin_wait.hpp). With spin_then_park, a thread spins for a while
+// before it sleeps, which suits very short critical sections.
+template<class WaitPolicy>
+class basic_shared_mutex {
 private:
-    details::shared_mutex_impl impl_;
+    details::shared_mutex_impl<WaitPolicy> impl_;
 
 public:
+    typedef WaitPolicy wait_policy;
+
     // Constructors and destructor
 
-    shared_mutex() : impl_() {}
-    ~shared_mutex() = default;
+    basic_shared_mutex() : impl_() {}
+    ~basic_shared_mutex() = default;
+
+    basic_shared_mutex(const basic_shared_mutex&) = delete;
+    basic_shared_mutex& operator=(const basic_shared_mutex&) = delete;
 
-    shared_mutex(const shared_mutex&) = delete;
-    shared_mutex& operator=(const shared_mutex&) = delete;
+    // tag the mutex in the lock profiles (see lock_profiler.hpp),
+    // which is a no-op unless CLUE_LOCK_PROFILING is defined
+    void set_name(const char *name) { impl_.set_name(name); }
 
     // Exclusive ownership
 
@@ -206,19 +293,24 @@ public:
     bool try_lock_shared() { return impl_.try_lock_shared(); }
     void unlock_shared()   { return impl_.unlock_shared(); }
 
-}; // end class shared_mutex
+}; // end class basic_shared_mutex
 
 
-class shared_timed_mutex {
+template<class WaitPolicy>
+class basic_shared_timed_mutex {
 private:
-    details::shared_mutex_impl impl_;
+    details::shared_mutex_impl<WaitPolicy> impl_;
 
 public:
-    shared_timed_mutex();
-    ~shared_timed_mutex() = default;
+    typedef WaitPolicy wait_policy;
+
+    basic_shared_timed_mutex() : impl_() {}
+    ~basic_shared_timed_mutex() = default;
 
-    shared_timed_mutex(const shared_timed_mutex&) = delete;
-    shared_timed_mutex& operator=(const shared_timed_mutex&) = delete;
+    basic_shared_timed_mutex(const basic_shared_timed_mutex&) = delete;
+    basic_shared_timed_mutex& operator=(const basic_shared_timed_mutex&) = delete;
+
+    void set_name(const char *name) { impl_.set_name(name); }
 
     // Exclusive ownership
 
@@ -252,7 +344,133 @@ public:
         return impl_.try_lock_shared_until(due_time);
     }
 
-}; // end class shared_timed_mutex
+}; // end class basic_shared_timed_mutex
+
+typedef basic_shared_mutex<blocking_wait> shared_mutex;
+typedef basic_shared_timed_mutex<blocking_wait> shared_timed_mutex;
+
+
+// A reader-writer lock for data that is read very often and written
+// rarely. Instead of a single reader count, each reader registers in one
+// of several cache-line-padded slots (chosen per thread), so readers on
+// different cores do not write to the same cache line. A writer raises
+// a flag, then scans the slots and waits until all readers have left.
+// Readers that see the flag back off until the writer is done, so a
+// stream of readers cannot starve the writers.
+//
+// It has the same interface as shared_mutex (and works with shared_lock
+// and unique_lock), but a write lock costs O(#slots).
+//
+class distributed_shared_mutex {
+private:
+    typedef details::padded_slot<std::atomic<long>> slot_t;
+
+    size_t mask_;
+    std::unique_ptr<slot_t[]> slots_;
+    std::atomic<bool> writer_;   // modified only under mut_
+    std::mutex mut_;
+    std::condition_variable cv_;
+
+public:
+    // The number of slots is rounded up to a power of two.
+    // By default, it is the number of hardware threads.
+    explicit distributed_shared_mutex(size_t nslots = 0)
+        : mask_(details::round_slots(nslots) - 1)
+        , slots_(new slot_t[mask_ + 1])
+        , writer_(false) {}
+
+    distributed_shared_mutex(const distributed_shared_mutex&) = delete;
+    distributed_shared_mutex& operator=(const distributed_shared_mutex&) = delete;
+
+    size_t num_slots() const noexcept {
+        return mask_ + 1;
+    }
+
+    // Exclusive ownership
+
+    void lock() {
+        std::unique_lock<std::mutex> lk(mut_);
+        cv_.wait(lk, [this](){ return !writer_.load(); });
+        writer_ = true;
+        lk.unlock();
+
+        // readers usually leave soon, spin for a while before parking
+        spin_wait sw;
+        while (readers_() != 0) {
+            if (!sw.spin_once()) {
+                lk.lock();
+                cv_.wait(lk, [this](){ return readers_() == 0; });
+                break;
+            }
+        }
+    }
+
+    bool try_lock() {
+        std::unique_lock<std::mutex> lk(mut_);
+        if (writer_.load()) return false;
+        writer_ = true;
+        if (readers_() != 0) {
+            writer_ = false;
+            cv_.notify_all();
+            return false;
+        }
+        return true;
+    }
+
+    void unlock() {
+        {
+            std::lock_guard<std::mutex> lk(mut_);
+            writer_ = false;
+        }
+        cv_.notify_all();
+    }
+
+    // Shared ownership
+
+    void lock_shared() {
+        slot_t& s = my_slot_();
+        while (!try_enter_(s)) {
+            std::unique_lock<std::mutex> lk(mut_);
+            cv_.wait(lk, [this](){ return !writer_.load(); });
+        }
+    }
+
+    bool try_lock_shared() {
+        return try_enter_(my_slot_());
+    }
+
+    void unlock_shared() {
+        leave_(my_slot_());
+    }
+
+private:
+    slot_t& my_slot_() {
+        return slots_[details::thread_slot_index() & mask_];
+    }
+
+    // The number of readers. A slot can go negative when a reader unlocks
+    // on another thread than it locked on (e.g. a moved shared_lock), so the
+    // writer waits for the sum, rather than for each slot, to drop to zero.
+    long readers_() const {
+        long r = 0;
+        for (size_t i = 0; i <= mask_; ++i) r += slots_[i].v.load();
+        return r;
+    }
+
+    // a Dekker-style handshake with lock() (see details::notify_parked)
+    bool try_enter_(slot_t& s) {
+        s.v.fetch_add(1);
+        if (!writer_.load()) return true;
+        leave_(s);
+        return false;
+    }
+
+    void leave_(slot_t& s) {
+        s.v.fetch_sub(1);
+        details::notify_parked(writer_, mut_, cv_);
+    }
+
+}; // end class distributed_shared_mutex
 
 
 template <class Mutex>
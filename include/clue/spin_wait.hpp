@@ -0,0 +1,176 @@
+/**
+ * @file spin_wait.hpp
+ *
+ * Facilities for bounded spinning before parking a thread.
+ */
+
+#ifndef CLUE_SPIN_WAIT__
+#define CLUE_SPIN_WAIT__
+
+#include <clue/common.hpp>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <utility>
+
+namespace clue {
+
+// Hint the processor that the caller is in a spin-wait loop
+// (e.g. to release pipeline resources to the sibling hyper-thread).
+inline void cpu_relax() noexcept {
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || defined(__arm__))
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+namespace details {
+
+// spin round r: issue 2^r pause instructions
+inline void cpu_pause(unsigned r) noexcept {
+    unsigned n = 1u << r;
+    for (unsigned i = 0; i < n; ++i) cpu_relax();
+}
+
+// Wake the threads parked on cv (under m), if w says that there are any.
+//
+// This is the waker's half of a Dekker-style handshake: the waker updates
+// the shared state and then loads w, while a parking thread raises w
+// (under m) and then checks the state in its predicate. Both sides are
+// seq_cst, so either the waker sees w raised, or the parking thread sees
+// the update and does not sleep. Taking m before notifying ensures that
+// a thread that is seen is either already waiting or yet to check its
+// predicate, so that no wake-up is lost.
+template<class T, class Mutex, class CondVar>
+inline void notify_parked(const std::atomic<T>& w, Mutex& m, CondVar& cv, bool all=true) {
+    if (w.load()) {
+        { std::lock_guard<Mutex> lk(m); }
+        if (all) cv.notify_all(); else cv.notify_one();
+    }
+}
+
+} // end namespace details
+
+// A helper to implement the spin-then-park strategy:
+//
+//  - for the first few rounds, it spins with an exponentially
+//    growing number of pause instructions;
+//  - then, it yields the time slice for a few rounds;
+//  - then, spin_once() returns false, which suggests that the
+//    caller should park itself (e.g. on a condition variable).
+//
+class spin_wait {
+private:
+    unsigned count_;
+
+public:
+    static constexpr unsigned pause_rounds = 10;
+    static constexpr unsigned yield_rounds = 10;
+
+    spin_wait() noexcept
+        : count_(0) {}
+
+    unsigned count() const noexcept {
+        return count_;
+    }
+
+    void reset() noexcept {
+        count_ = 0;
+    }
+
+    bool spin_once() {
+        if (count_ < pause_rounds) {
+            details::cpu_pause(count_);
+        } else if (count_ < pause_rounds + yield_rounds) {
+            std::this_thread::yield();
+        } else {
+            return false;
+        }
+        ++count_;
+        return true;
+    }
+};
+
+
+// Wait policies
+//
+// A wait policy decides how a thread acquires the internal mutex of a
+// primitive (e.g. concurrent_queue or shared_mutex), and how it waits on
+// a condition variable for a predicate (which is checked under the lock).
+// The primitives take the policy as a template parameter:
+//
+//  - blocking_wait: lock and wait directly (sleep in the kernel at once);
+//  - spin_then_park<Rounds>: for Rounds rounds, release the lock and spin
+//    with an exponentially growing number of pause instructions before
+//    re-checking, and only then park on the condition variable. This
+//    avoids the sleep/wake round trip when the waited-for condition is
+//    usually met within a very short time.
+//
+
+struct blocking_wait {
+    template<class Mutex>
+    static void lock(Mutex& m) {
+        m.lock();
+    }
+
+    template<class Lock, class CondVar, class Pred>
+    static void wait(Lock& lk, CondVar& cv, Pred&& pred) {
+        cv.wait(lk, std::forward<Pred>(pred));
+    }
+
+    template<class Lock, class CondVar, class Clock, class Duration, class Pred>
+    static bool wait_until(Lock& lk, CondVar& cv,
+                           const std::chrono::time_point<Clock, Duration>& t,
+                           Pred&& pred) {
+        return cv.wait_until(lk, t, std::forward<Pred>(pred));
+    }
+};
+
+template<unsigned Rounds=8>
+struct spin_then_park {
+    static_assert(Rounds < 16,
+        "spin_then_park: Rounds must be less than 16.");
+
+    static constexpr unsigned spin_rounds = Rounds;
+
+    template<class Mutex>
+    static void lock(Mutex& m) {
+        for (unsigned r = 0; r < Rounds; ++r) {
+            if (m.try_lock()) return;
+            details::cpu_pause(r);
+        }
+        m.lock();
+    }
+
+    template<class Lock, class CondVar, class Pred>
+    static void wait(Lock& lk, CondVar& cv, Pred&& pred) {
+        for (unsigned r = 0; r < Rounds; ++r) {
+            if (pred()) return;
+            lk.unlock();
+            details::cpu_pause(r);
+            lk.lock();
+        }
+        cv.wait(lk, std::forward<Pred>(pred));
+    }
+
+    // like wait, but parks until the time point t at most,
+    // and returns pred() (as condition_variable::wait_until)
+    template<class Lock, class CondVar, class Clock, class Duration, class Pred>
+    static bool wait_until(Lock& lk, CondVar& cv,
+                           const std::chrono::time_point<Clock, Duration>& t,
+                           Pred&& pred) {
+        for (unsigned r = 0; r < Rounds; ++r) {
+            if (pred()) return true;
+            lk.unlock();
+            details::cpu_pause(r);
+            lk.lock();
+        }
+        return cv.wait_until(lk, t, std::forward<Pred>(pred));
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * @file spsc_queue.hpp
+ *
+ * A wait-free bounded single-producer/single-consumer queue.
+ */
+
+#ifndef CLUE_SPSC_QUEUE__
+#define CLUE_SPSC_QUEUE__
+
+#include <clue/common.hpp>
+#include <clue/spin_wait.hpp>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <limits>
+#include <stdexcept>
+
+namespace clue {
+
+// Exactly one thread may push (producer) and exactly one thread may pop
+// (consumer) at any time. The try_* and *_n operations are wait-free.
+//
+// Each side keeps a cached copy of the other side's index, and reloads
+// it only when the cached copy suggests that the queue is full (for the
+// producer) or empty (for the consumer). Hence, the cache line that holds
+// the peer's index is only touched once in a while.
+//
+template<class T>
+class spsc_queue final {
+private:
+    using storage_t = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    char pad0_[CLUE_CACHELINE_SIZE];
+
+    // consumer side
+    std::atomic<size_t> head_;
+    size_t tail_cache_;
+    char pad1_[CLUE_CACHELINE_SIZE - 2 * sizeof(size_t)];
+
+    // producer side
+    std::atomic<size_t> tail_;
+    size_t head_cache_;
+    char pad2_[CLUE_CACHELINE_SIZE - 2 * sizeof(size_t)];
+
+    const size_t mask_;
+    std::unique_ptr<storage_t[]> buf_;
+
+public:
+    // the capacity is rounded up to a power of two (at least 2),
+    // std::length_error is thrown if that overflows
+    explicit spsc_queue(size_t cap)
+        : head_(0)
+        , tail_cache_(0)
+        , tail_(0)
+        , head_cache_(0)
+        , mask_(round_cap_(cap) - 1)
+        , buf_(new storage_t[mask_ + 1]) {}
+
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    ~spsc_queue() {
+        clear();
+    }
+
+    size_t capacity() const noexcept {
+        return mask_ + 1;
+    }
+
+    // the number of elements (it is approximate when
+    // the producer or the consumer is active)
+    size_t size() const noexcept {
+        size_t h = head_.load(std::memory_order_acquire);
+        size_t t = tail_.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    bool empty() const noexcept {
+        return size() == 0;
+    }
+
+    // can only be called by the consumer
+    void clear() {
+        size_t h = head_.load(std::memory_order_relaxed);
+        size_t t = tail_.load(std::memory_order_acquire);
+        for (; h != t; ++h) at_(h)->~T();
+        head_.store(h, std::memory_order_release);
+    }
+
+    // Producer: construct an element from args at the back,
+    // or return false immediately if the queue is full.
+    template<class... Args>
+    bool try_push(Args&&... args) {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        if (t - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (t - head_cache_ > mask_) return false;
+        }
+        new(at_(t)) T(std::forward<Args>(args)...);
+        tail_.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer: push an element, spinning while the queue is full
+    template<class... Args>
+    void push(Args&&... args) {
+        spin_wait sw;
+        while (!try_push(std::forward<Args>(args)...)) {
+            if (!sw.spin_once()) std::this_thread::yield();
+        }
+    }
+
+    // Producer: push up to n elements from the range starting at first,
+    // and return the number of elements that have been pushed. All of them
+    // are published to the consumer at once.
+    //
+    // If copying an element throws, the elements of the batch that have
+    // been constructed are destroyed, nothing is pushed, and the exception
+    // is propagated.
+    template<class InputIter>
+    size_t push_n(InputIter first, size_t n) {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        size_t a = capacity() - (t - head_cache_);
+        if (a < n) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            a = capacity() - (t - head_cache_);
+        }
+        if (n > a) n = a;
+        size_t i = 0;
+        try {
+            for (; i < n; ++i, ++first) {
+                new(at_(t + i)) T(*first);
+            }
+        } catch (...) {
+            while (i > 0) at_(t + --i)->~T();
+            throw;
+        }
+        if (n > 0) tail_.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: pop the front element to dst,
+    // or return false immediately if the queue is empty.
+    bool try_pop(T& dst) {
+        size_t h = head_.load(std::memory_order_relaxed);
+        if (h == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (h == tail_cache_) return false;
+        }
+        T *p = at_(h);
+        dst = std::move(*p);
+        p->~T();
+        head_.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: pop the front element, spinning while the queue is empty
+    T wait_pop() {
+        size_t h = head_.load(std::memory_order_relaxed);
+        spin_wait sw;
+        while (h == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (h == tail_cache_ && !sw.spin_once()) std::this_thread::yield();
+        }
+        T *p = at_(h);
+        T x(std::move(*p));
+        p->~T();
+        head_.store(h + 1, std::memory_order_release);
+        return x;
+    }
+
+    // Consumer: pop up to n elements to the range starting at dst,
+    // and return the number of elements that have been popped. The
+    // slots are released to the producer at once.
+    //
+    // If moving an element out throws, that element is popped (and
+    // destroyed) along with those before it, and the exception is
+    // propagated.
+    template<class OutputIter>
+    size_t pop_n(OutputIter dst, size_t n) {
+        size_t h = head_.load(std::memory_order_relaxed);
+        size_t a = tail_cache_ - h;
+        if (a < n) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            a = tail_cache_ - h;
+        }
+        if (n > a) n = a;
+        size_t i = 0;
+        try {
+            for (; i < n; ++i, ++dst) {
+                T *p = at_(h + i);
+                *dst = std::move(*p);
+                p->~T();
+            }
+        } catch (...) {
+            at_(h + i)->~T();
+            head_.store(h + i + 1, std::memory_order_release);
+            throw;
+        }
+        if (n > 0) head_.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    static size_t round_cap_(size_t cap) {
+        if (cap > (std::numeric_limits<size_t>::max() >> 1) + 1) {
+            throw std::length_error(
+                "spsc_queue: the capacity is too large.");
+        }
+        size_t c = 2;
+        while (c < cap) c <<= 1;
+        return c;
+    }
+
+    T* at_(size_t i) const noexcept {
+        return reinterpret_cast<T*>(&buf_[i & mask_]);
+    }
+};
+
+} // end namespace clue
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * @file task_function.hpp
+ *
+ * A move-only function wrapper with inline (small-buffer) storage.
+ */
+
+#ifndef CLUE_TASK_FUNCTION__
+#define CLUE_TASK_FUNCTION__
+
+#include <clue/common.hpp>
+#include <utility>
+#include <memory>
+#include <new>
+
+namespace clue {
+
+template<class Sig, size_t N=64, class Alloc=std::allocator<char>>
+class task_function;
+
+namespace details {
+
+template<class R>
+struct task_invoker {
+    template<class F, class... Args>
+    static R invoke(F& f, Args&&... args) {
+        return f(std::forward<Args>(args)...);
+    }
+};
+
+template<>
+struct task_invoker<void> {
+    template<class F, class... Args>
+    static void invoke(F& f, Args&&... args) {
+        f(std::forward<Args>(args)...);
+    }
+};
+
+} // end namespace details
+
+
+// Unlike std::function, task_function is move-only (so it can hold
+// move-only callables such as packaged_task), and it stores callables of
+// up to N bytes inline, without dynamic memory allocation. Larger ones
+// (or those that may throw when moved) are stored on the heap, through
+// Alloc (rebound to the callable type), which must be stateless.
+//
+template<class R, class... Args, size_t N, class Alloc>
+class task_function<R(Args...), N, Alloc> {
+private:
+    static_assert(std::is_empty<Alloc>::value,
+        "task_function: Alloc must be stateless.");
+
+    using storage_t = typename std::aligned_storage<N>::type;
+
+    struct vtable_t {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void*, void*) noexcept;  // move-construct dst from src
+        void (*destroy)(void*) noexcept;
+        bool is_inline;
+    };
+
+    template<class F>
+    struct inline_ops {
+        static R invoke(void *p, Args&&... args) {
+            return details::task_invoker<R>::invoke(
+                *static_cast<F*>(p), std::forward<Args>(args)...);
+        }
+
+        static void move(void *dst, void *src) noexcept {
+            F *s = static_cast<F*>(src);
+            new(dst) F(std::move(*s));
+            s->~F();
+        }
+
+        static void destroy(void *p) noexcept {
+            static_cast<F*>(p)->~F();
+        }
+
+        static const vtable_t* vtable() noexcept {
+            static const vtable_t vt = {&invoke, &move, &destroy, true};
+            return &vt;
+        }
+    };
+
+    template<class F>
+    struct heap_ops {
+        using alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<F>;
+
+        static F*& ptr(void *p) noexcept {
+            return *static_cast<F**>(p);
+        }
+
+        static R invoke(void *p, Args&&... args) {
+            return details::task_invoker<R>::invoke(
+                *ptr(p), std::forward<Args>(args)...);
+        }
+
+        static void move(void *dst, void *src) noexcept {
+            new(dst) F*(ptr(src));
+        }
+
+        static void destroy(void *p) noexcept {
+            F *f = ptr(p);
+            f->~F();
+            alloc_t().deallocate(f, 1);
+        }
+
+        static const vtable_t* vtable() noexcept {
+            static const vtable_t vt = {&invoke, &move, &destroy, false};
+            return &vt;
+        }
+    };
+
+    template<class F>
+    struct fits_inline {
+        static constexpr bool value =
+            sizeof(F) <= N &&
+            alignof(storage_t) % alignof(F) == 0 &&
+            std::is_nothrow_move_constructible<F>::value;
+    };
+
+    storage_t buf_;
+    const vtable_t *vt_;
+
+public:
+    static constexpr size_t inline_capacity = N;
+
+    task_function() noexcept
+        : vt_(nullptr) {}
+
+    task_function(std::nullptr_t) noexcept
+        : vt_(nullptr) {}
+
+    template<class F,
+             class D = typename std::decay<F>::type,
+             CLUE_REQUIRE(!std::is_same<D, task_function>::value)>
+    task_function(F&& f) {
+        init_(std::forward<F>(f),
+              std::integral_constant<bool, fits_inline<D>::value>{});
+    }
+
+    task_function(task_function&& other) noexcept
+        : vt_(other.vt_) {
+        if (vt_) {
+            vt_->move(&buf_, &other.buf_);
+            other.vt_ = nullptr;
+        }
+    }
+
+    task_function(const task_function&) = delete;
+    task_function& operator=(const task_function&) = delete;
+
+    ~task_function() {
+        reset();
+    }
+
+    task_function& operator=(task_function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.vt_) {
+                other.vt_->move(&buf_, &other.buf_);
+                vt_ = other.vt_;
+                other.vt_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    task_function& operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    void reset() noexcept {
+        if (vt_) {
+            vt_->destroy(&buf_);
+            vt_ = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept {
+        return vt_ != nullptr;
+    }
+
+    // whether the callable is stored inline (without heap allocation)
+    bool is_inline() const noexcept {
+        return vt_ && vt_->is_inline;
+    }
+
+    R operator()(Args... args) {
+        CLUE_ASSERT(vt_);
+        return vt_->invoke(&buf_, std::forward<Args>(args)...);
+    }
+
+private:
+    template<class F>
+    void init_(F&& f, std::true_type) {
+        using D = typename std::decay<F>::type;
+        new(&buf_) D(std::forward<F>(f));
+        vt_ = inline_ops<D>::vtable();
+    }
+
+    template<class F>
+    void init_(F&& f, std::false_type) {
+        using D = typename std::decay<F>::type;
+        typename heap_ops<D>::alloc_t a;
+        D *p = a.allocate(1);
+        try {
+            new(p) D(std::forward<F>(f));
+        } catch (...) {
+            a.deallocate(p, 1);
+            throw;
+        }
+        new(&buf_) D*(p);
+        vt_ = heap_ops<D>::vtable();
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,583 @@
+/**
+ * @file task_graph.hpp
+ *
+ * Continuations, combinators, and task graphs on top of thread_pool.
+ */
+
+#ifndef CLUE_TASK_GRAPH__
+#define CLUE_TASK_GRAPH__
+
+#include <clue/thread_pool.hpp>
+#include <clue/optional.hpp>
+#include <initializer_list>
+
+namespace clue {
+
+template<class T> class task_handle;
+
+namespace details {
+
+// The shared state of task handles. Once a value or an exception is
+// set, the registered callbacks are run in the thread that sets it.
+class cont_state_base {
+private:
+    mutable std::mutex mut_;
+    mutable std::condition_variable cv_;
+    bool ready_ = false;
+    std::vector<task_function<void()>> callbacks_;
+
+protected:
+    std::exception_ptr ex_;
+
+public:
+    cont_state_base() = default;
+    cont_state_base(const cont_state_base&) = delete;
+    cont_state_base& operator=(const cont_state_base&) = delete;
+
+    bool ready() const {
+        std::lock_guard<std::mutex> lk(mut_);
+        return ready_;
+    }
+
+    void wait() const {
+        std::unique_lock<std::mutex> lk(mut_);
+        cv_.wait(lk, [this](){ return ready_; });
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& dur) const {
+        std::unique_lock<std::mutex> lk(mut_);
+        return cv_.wait_for(lk, dur, [this](){ return ready_; });
+    }
+
+    // the exception (can only be called when ready)
+    std::exception_ptr exception() const noexcept {
+        return ex_;
+    }
+
+    void set_exception(std::exception_ptr e) {
+        complete_([this, &e](){ ex_ = std::move(e); });
+    }
+
+    // run f() once ready (immediately in the calling thread if ready)
+    void on_ready(task_function<void()> f) {
+        {
+            std::lock_guard<std::mutex> lk(mut_);
+            if (!ready_) {
+                callbacks_.push_back(std::move(f));
+                return;
+            }
+        }
+        f();
+    }
+
+protected:
+    template<class Setter>
+    void complete_(Setter&& set) {
+        std::vector<task_function<void()>> cbs;
+        {
+            std::lock_guard<std::mutex> lk(mut_);
+            CLUE_ASSERT(!ready_);
+            set();
+            ready_ = true;
+            cbs.swap(callbacks_);
+        }
+        cv_.notify_all();
+        for (auto& f: cbs) f();
+    }
+};
+
+template<class T>
+class cont_state : public cont_state_base {
+private:
+    optional<T> v_;
+
+public:
+    template<class U>
+    void set_value(U&& v) {
+        complete_([this, &v](){ v_.emplace(std::forward<U>(v)); });
+    }
+
+    // the value (can only be called when ready without exception)
+    const T& value() const {
+        return *v_;
+    }
+
+    const T& get() const {
+        wait();
+        if (ex_) std::rethrow_exception(ex_);
+        return *v_;
+    }
+};
+
+template<>
+class cont_state<void> : public cont_state_base {
+public:
+    void set_value() {
+        complete_([](){});
+    }
+
+    void get() const {
+        wait();
+        if (ex_) std::rethrow_exception(ex_);
+    }
+};
+
+// invoke f(args...) and set the result (or the exception) to st
+template<class R>
+struct cont_invoker {
+    template<class F, class... Args>
+    static void run(cont_state<R>& st, F& f, Args&&... args) {
+        optional<R> r;
+        try {
+            r.emplace(f(std::forward<Args>(args)...));
+        } catch (...) {
+            st.set_exception(std::current_exception());
+            return;
+        }
+        st.set_value(std::move(*r));
+    }
+};
+
+template<>
+struct cont_invoker<void> {
+    template<class F, class... Args>
+    static void run(cont_state<void>& st, F& f, Args&&... args) {
+        try {
+            f(std::forward<Args>(args)...);
+        } catch (...) {
+            st.set_exception(std::current_exception());
+            return;
+        }
+        st.set_value();
+    }
+};
+
+// the result type of a continuation f of a task_handle<T>
+template<class T, class F>
+struct cont_result {
+    using type = typename std::result_of<F&(size_t, const T&)>::type;
+};
+
+template<class F>
+struct cont_result<void, F> {
+    using type = typename std::result_of<F&(size_t)>::type;
+};
+
+template<class R, class F>
+struct launch_task {
+    std::shared_ptr<cont_state<R>> st;
+    F f;
+
+    void operator()(size_t tidx) {
+        cont_invoker<R>::run(*st, f, tidx);
+    }
+};
+
+// run f(tidx, prev value) on a worker
+template<class T, class R, class F>
+struct then_task {
+    std::shared_ptr<cont_state<T>> prev;
+    std::shared_ptr<cont_state<R>> next;
+    F f;
+
+    void operator()(size_t tidx) {
+        cont_invoker<R>::run(*next, f, tidx, prev->value());
+    }
+};
+
+template<class R, class F>
+struct then_task<void, R, F> {
+    std::shared_ptr<cont_state<void>> prev;
+    std::shared_ptr<cont_state<R>> next;
+    F f;
+
+    void operator()(size_t tidx) {
+        cont_invoker<R>::run(*next, f, tidx);
+    }
+};
+
+// registered on the previous state: once it is ready, post the
+// continuation to the pool, or forward the exception
+template<class T, class R, class F>
+struct then_callback {
+    thread_pool *pool;
+    then_task<T, R, F> task;
+
+    void operator()() {
+        if (std::exception_ptr e = task.prev->exception()) {
+            task.next->set_exception(e);
+            return;
+        }
+        std::shared_ptr<cont_state<R>> next = task.next;
+        try {
+            pool->post(std::move(task));
+        } catch (...) {
+            next->set_exception(std::current_exception());
+        }
+    }
+};
+
+} // end namespace details
+
+
+// A handle to the result of a task launched on a thread_pool. Unlike
+// std::future, one can attach continuations to it, which are scheduled
+// to the pool when the result is ready, without blocking any thread.
+// Handles are copyable and share the same result.
+//
+template<class T>
+class task_handle {
+public:
+    typedef T value_type;
+    typedef details::cont_state<T> state_type;
+
+private:
+    std::shared_ptr<state_type> sp_;
+
+public:
+    task_handle() noexcept {}
+
+    explicit task_handle(std::shared_ptr<state_type> sp) noexcept
+        : sp_(std::move(sp)) {}
+
+    bool valid() const noexcept {
+        return static_cast<bool>(sp_);
+    }
+
+    bool ready() const {
+        return sp_->ready();
+    }
+
+    void wait() const {
+        sp_->wait();
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& dur) const {
+        return sp_->wait_for(dur);
+    }
+
+    // block until ready, and get the value or re-throw the exception
+    auto get() const -> decltype(std::declval<const state_type&>().get()) {
+        return sp_->get();
+    }
+
+    // Call f() once ready, in the thread that makes it ready (or in
+    // the calling thread if it is already ready). f should be quick.
+    template<class F>
+    void on_ready(F&& f) const {
+        sp_->on_ready(task_function<void()>(std::forward<F>(f)));
+    }
+
+    // Schedule f(tidx, value) (or f(tidx) when T is void) to the pool
+    // once ready, and return the handle to its result. If this task
+    // fails, f is not called and the exception is forwarded.
+    template<class F,
+             class R = typename details::cont_result<T, F>::type>
+    task_handle<R> then(thread_pool& pool, F&& f) const {
+        using D = typename std::decay<F>::type;
+        auto next = std::make_shared<details::cont_state<R>>();
+        sp_->on_ready(details::then_callback<T, R, D>{
+            &pool, details::then_task<T, R, D>{sp_, next, std::forward<F>(f)}});
+        return task_handle<R>(next);
+    }
+};
+
+
+// Launch f(tidx) on the pool, and return the handle to its result.
+template<class F,
+         class R = typename std::result_of<F&(size_t)>::type>
+inline task_handle<R> launch(thread_pool& pool, F&& f) {
+    using D = typename std::decay<F>::type;
+    auto st = std::make_shared<details::cont_state<R>>();
+    pool.post(details::launch_task<R, D>{st, std::forward<F>(f)});
+    return task_handle<R>(st);
+}
+
+
+namespace details {
+
+template<class T>
+struct when_all_ctx {
+    std::vector<task_handle<T>> ins;
+    std::shared_ptr<cont_state<std::vector<T>>> out;
+    std::atomic<size_t> remain;
+
+    void finish() {
+        std::vector<T> vs;
+        vs.reserve(ins.size());
+        for (const auto& h: ins) {
+            try {
+                vs.push_back(h.get());
+            } catch (...) {
+                out->set_exception(std::current_exception());
+                return;
+            }
+        }
+        out->set_value(std::move(vs));
+    }
+};
+
+template<>
+struct when_all_ctx<void> {
+    std::vector<task_handle<void>> ins;
+    std::shared_ptr<cont_state<void>> out;
+    std::atomic<size_t> remain;
+
+    void finish() {
+        for (const auto& h: ins) {
+            try {
+                h.get();
+            } catch (...) {
+                out->set_exception(std::current_exception());
+                return;
+            }
+        }
+        out->set_value();
+    }
+};
+
+template<class T>
+struct when_all_result {
+    using type = std::vector<T>;
+};
+
+template<>
+struct when_all_result<void> {
+    using type = void;
+};
+
+} // end namespace details
+
+
+// Get a handle that becomes ready when all the given tasks are ready.
+// Its value is the list of their values (nothing when T is void), or
+// the exception of the first failed one (in the input order).
+template<class T>
+inline task_handle<typename details::when_all_result<T>::type>
+when_all(std::vector<task_handle<T>> hs) {
+    using R = typename details::when_all_result<T>::type;
+    auto ctx = std::make_shared<details::when_all_ctx<T>>();
+    ctx->out = std::make_shared<details::cont_state<R>>();
+    ctx->remain = hs.size();
+    ctx->ins = std::move(hs);
+    task_handle<R> r(ctx->out);
+
+    if (ctx->ins.empty()) {
+        ctx->finish();
+    } else {
+        for (const auto& h: ctx->ins) {
+            h.on_ready([ctx](){
+                if (--(ctx->remain) == 0) ctx->finish();
+            });
+        }
+    }
+    return r;
+}
+
+// Get a handle that becomes ready when any of the given tasks is ready.
+// Its value is the index of the first one that is ready.
+template<class T>
+inline task_handle<size_t> when_any(const std::vector<task_handle<T>>& hs) {
+    if (hs.empty()) {
+        throw std::invalid_argument("when_any: The list of tasks is empty.");
+    }
+    auto out = std::make_shared<details::cont_state<size_t>>();
+    auto flag = std::make_shared<std::atomic<bool>>(false);
+    for (size_t i = 0; i < hs.size(); ++i) {
+        hs[i].on_ready([out, flag, i](){
+            if (!flag->exchange(true)) out->set_value(i);
+        });
+    }
+    return task_handle<size_t>(out);
+}
+
+
+// A directed acyclic graph of tasks. When run on a pool, each task is
+// scheduled as soon as all its predecessors have finished, so no worker
+// ever blocks on another task.
+//
+// A graph can be run multiple times, but should not be modified while
+// it is running. If a task throws, the tasks that have not started
+// are skipped, and the exception is reported by the handle of the run.
+//
+class task_graph {
+public:
+    typedef size_t node_id;
+
+private:
+    struct node_t {
+        mutable task_function<void(size_t)> fn;
+        std::vector<node_id> succs;
+        size_t n_preds = 0;
+    };
+    typedef std::vector<node_t> nodes_t;
+
+    struct exec_t {
+        std::shared_ptr<const nodes_t> nodes;
+        thread_pool *pool;
+        std::unique_ptr<std::atomic<size_t>[]> pending;  // # unfinished preds
+        std::atomic<size_t> remain;                      // # unfinished nodes
+        std::atomic<bool> failed;
+        std::exception_ptr ex;
+        std::shared_ptr<details::cont_state<void>> done;
+    };
+
+    std::shared_ptr<nodes_t> nodes_;
+
+public:
+    task_graph()
+        : nodes_(std::make_shared<nodes_t>()) {}
+
+    task_graph(const task_graph&) = delete;
+    task_graph& operator=(const task_graph&) = delete;
+
+    task_graph(task_graph&& r)
+        : nodes_(std::move(r.nodes_)) {
+        r.nodes_ = std::make_shared<nodes_t>();
+    }
+
+    size_t size() const noexcept {
+        return nodes_->size();
+    }
+
+    // add a task f(tidx), and return its id
+    template<class F>
+    node_id add(F&& f) {
+        check_modifiable_("task_graph::add");
+        nodes_->emplace_back();
+        nodes_->back().fn = task_function<void(size_t)>(std::forward<F>(f));
+        return nodes_->size() - 1;
+    }
+
+    // add a task f(tidx) that runs after all of preds
+    template<class F>
+    node_id add(F&& f, std::initializer_list<node_id> preds) {
+        node_id v = add(std::forward<F>(f));
+        for (node_id u: preds) precede(u, v);
+        return v;
+    }
+
+    // make the task v run after the task u
+    void precede(node_id u, node_id v) {
+        check_modifiable_("task_graph::precede");
+        if (u >= nodes_->size() || v >= nodes_->size()) {
+            throw std::out_of_range("task_graph::precede: Node id out of range.");
+        }
+        (*nodes_)[u].succs.push_back(v);
+        (*nodes_)[v].n_preds ++;
+    }
+
+    // Schedule the tasks without predecessors to the pool, and return
+    // a handle that becomes ready when all tasks have finished.
+    task_handle<void> run(thread_pool& pool) const {
+        check_acyclic_();
+        auto done = std::make_shared<details::cont_state<void>>();
+        size_t n = nodes_->size();
+        if (n == 0) {
+            done->set_value();
+            return task_handle<void>(done);
+        }
+
+        auto ex = std::make_shared<exec_t>();
+        ex->nodes = nodes_;
+        ex->pool = &pool;
+        ex->pending.reset(new std::atomic<size_t>[n]);
+        for (size_t i = 0; i < n; ++i) ex->pending[i] = (*nodes_)[i].n_preds;
+        ex->remain = n;
+        ex->failed = false;
+        ex->done = done;
+
+        try {
+            for (size_t i = 0; i < n; ++i) {
+                if ((*nodes_)[i].n_preds == 0) {
+                    pool.post([ex, i](size_t tidx){ run_node_(ex, i, tidx); });
+                }
+            }
+        } catch (...) {
+            // the roots not posted never run (so remain never reaches
+            // zero): stop the posted ones from running their tasks, and
+            // report the failure through the handle
+            ex->failed = true;
+            done->set_exception(std::current_exception());
+        }
+        return task_handle<void>(done);
+    }
+
+private:
+    void check_modifiable_(const char *fname) const {
+        if (nodes_.use_count() > 1) {
+            throw std::logic_error(std::string(fname) + ": "
+                "Cannot modify the graph while it is running.");
+        }
+    }
+
+    void check_acyclic_() const {
+        const nodes_t& nodes = *nodes_;
+        std::vector<size_t> indeg(nodes.size());
+        std::vector<node_id> ready;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            indeg[i] = nodes[i].n_preds;
+            if (indeg[i] == 0) ready.push_back(i);
+        }
+        size_t nv = 0;
+        while (!ready.empty()) {
+            node_id u = ready.back();
+            ready.pop_back();
+            ++nv;
+            for (node_id v: nodes[u].succs) {
+                if (--indeg[v] == 0) ready.push_back(v);
+            }
+        }
+        if (nv < nodes.size()) {
+            throw std::invalid_argument(
+                "task_graph::run: The graph contains a cycle.");
+        }
+    }
+
+    // Run node i, then release its successors: all but one of those that
+    // become ready are posted to the pool, and the last one is run by the
+    // current worker directly.
+    static void run_node_(const std::shared_ptr<exec_t>& ex, node_id i, size_t tidx) {
+        const nodes_t& nodes = *(ex->nodes);
+        for (;;) {
+            if (!ex->failed.load()) {
+                try {
+                    nodes[i].fn(tidx);
+                } catch (...) {
+                    if (!ex->failed.exchange(true)) ex->ex = std::current_exception();
+                }
+            }
+
+            node_id next = static_cast<node_id>(-1);
+            for (node_id v: nodes[i].succs) {
+                if (--(ex->pending[v]) == 0) {
+                    if (next != static_cast<node_id>(-1)) {
+                        std::shared_ptr<exec_t> sp = ex;
+                        ex->pool->post([sp, next](size_t t){ run_node_(sp, next, t); });
+                    }
+                    next = v;
+                }
+            }
+
+            if (--(ex->remain) == 0) {
+                // release the graph before reporting, so that it can
+                // be modified once the run is seen to be done
+                ex->nodes.reset();
+                if (ex->ex) {
+                    ex->done->set_exception(ex->ex);
+                } else {
+                    ex->done->set_value();
+                }
+                return;
+            }
+            if (next == static_cast<node_id>(-1)) return;
+            i = next;
+        }
+    }
+};
+
+}
+
+#endif
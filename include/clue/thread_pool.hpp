@@ -2,34 +2,459 @@
 #define CLUE_THREAD_POOL__
 
 #include <clue/common.hpp>
+#include <clue/concurrent_counter.hpp>
+#include <clue/task_function.hpp>
+#include <clue/object_pool.hpp>
+#include <clue/timing.hpp>
+#include <clue/cpu_affinity.hpp>
+#include <clue/spin_wait.hpp>
 #include <memory>
+#include <atomic>
+#include <exception>
+#include <iterator>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 #include <future>
 #include <vector>
-#include <queue>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <functional>
+#include <array>
 #include <stdexcept>
 #include <cstdio>
 
 namespace clue {
 
+namespace details {
+
+// A FIFO queue on a circular buffer. The capacity grows (doubles) as
+// needed but never shrinks, so that once it reaches the working size,
+// pushing and popping no longer allocate memory.
+template<class T>
+class task_ring {
+private:
+    T *buf_;
+    size_t cap_;   // always a power of two (or zero)
+    size_t head_;
+    size_t n_;
+
+public:
+    task_ring() noexcept
+        : buf_(nullptr), cap_(0), head_(0), n_(0) {}
+
+    task_ring(const task_ring&) = delete;
+    task_ring& operator=(const task_ring&) = delete;
+
+    ~task_ring() {
+        clear();
+        if (buf_) std::allocator<T>().deallocate(buf_, cap_);
+    }
+
+    bool empty() const noexcept {
+        return n_ == 0;
+    }
+
+    size_t size() const noexcept {
+        return n_;
+    }
+
+    T& front() noexcept {
+        return buf_[head_];
+    }
+
+    T& back() noexcept {
+        return buf_[(head_ + n_ - 1) & (cap_ - 1)];
+    }
+
+    template<class... Args>
+    void emplace(Args&&... args) {
+        if (n_ == cap_) grow_();
+        new(buf_ + ((head_ + n_) & (cap_ - 1))) T(std::forward<Args>(args)...);
+        ++n_;
+    }
+
+    void pop() noexcept {
+        buf_[head_].~T();
+        head_ = (head_ + 1) & (cap_ - 1);
+        --n_;
+    }
+
+    void clear() noexcept {
+        while (n_ > 0) pop();
+        head_ = 0;
+    }
+
+private:
+    void grow_() {
+        size_t new_cap = cap_ > 0 ? cap_ * 2 : 16;
+        T *new_buf = std::allocator<T>().allocate(new_cap);
+        for (size_t i = 0; i < n_; ++i) {
+            T& x = buf_[(head_ + i) & (cap_ - 1)];
+            new(new_buf + i) T(std::move(x));
+            x.~T();
+        }
+        if (buf_) std::allocator<T>().deallocate(buf_, cap_);
+        buf_ = new_buf;
+        cap_ = new_cap;
+        head_ = 0;
+    }
+};
+
+// The shared descriptor of a bulk of tasks over an index range.
+// Each runner repeatedly claims the next chunk of indices, until
+// the range is exhausted.
+class bulk_state_base {
+private:
+    std::atomic<size_t> next_;
+    const size_t n_;
+    const size_t chunk_;
+    concurrent_counter remain_;   // # indices yet to be processed
+    std::mutex ex_mut_;
+    std::exception_ptr ex_;
+
+public:
+    bulk_state_base(size_t n, size_t chunk)
+        : next_(0)
+        , n_(n)
+        , chunk_(chunk)
+        , remain_(static_cast<long>(n)) {}
+
+    virtual ~bulk_state_base() {}
+
+    size_t size() const noexcept {
+        return n_;
+    }
+
+    size_t chunk_size() const noexcept {
+        return chunk_;
+    }
+
+    bool done() const {
+        return remain_.get() == 0;
+    }
+
+    void wait() {
+        remain_.wait(0L);
+        if (ex_) std::rethrow_exception(ex_);
+    }
+
+    void run(size_t tidx) {
+        size_t b;
+        while ((b = next_.fetch_add(chunk_)) < n_) {
+            size_t e = b + chunk_ < n_ ? b + chunk_ : n_;
+            try {
+                run_chunk(tidx, b, e);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(ex_mut_);
+                if (!ex_) ex_ = std::current_exception();
+            }
+            remain_.dec(static_cast<long>(e - b));
+        }
+    }
+
+protected:
+    // process the indices in [b, e) (relative to the range start)
+    virtual void run_chunk(size_t tidx, size_t b, size_t e) = 0;
+};
+
+template<class Index, class F>
+class bulk_state final : public bulk_state_base {
+private:
+    Index first_;
+    F f_;
+
+public:
+    template<class G>
+    bulk_state(Index first, size_t n, size_t chunk, G&& f)
+        : bulk_state_base(n, chunk)
+        , first_(first)
+        , f_(std::forward<G>(f)) {}
+
+protected:
+    void run_chunk(size_t tidx, size_t b, size_t e) override {
+        for (size_t i = b; i < e; ++i) {
+            f_(tidx, static_cast<Index>(first_ + static_cast<Index>(i)));
+        }
+    }
+};
+
+} // end namespace details
+
+
+// The handle to a bulk of tasks scheduled by thread_pool::schedule_bulk.
+// The completion of the whole bulk is tracked by a single latch.
+class bulk_handle {
+private:
+    std::shared_ptr<details::bulk_state_base> sp_;
+
+public:
+    bulk_handle() noexcept {}
+
+    explicit bulk_handle(std::shared_ptr<details::bulk_state_base> sp) noexcept
+        : sp_(std::move(sp)) {}
+
+    bool valid() const noexcept {
+        return static_cast<bool>(sp_);
+    }
+
+    // the number of indices in the bulk
+    size_t size() const noexcept {
+        return sp_ ? sp_->size() : 0;
+    }
+
+    // the number of indices claimed by a worker at a time
+    size_t chunk_size() const noexcept {
+        return sp_ ? sp_->chunk_size() : 0;
+    }
+
+    bool done() const {
+        return !sp_ || sp_->done();
+    }
+
+    // block until all indices have been processed, and re-throw the
+    // first exception (if any) thrown by the function
+    void wait() const {
+        if (sp_) sp_->wait();
+    }
+};
+
+
+// The placement of the workers of a thread_pool. Worker i is pinned to
+// the CPUs of group i % groups.size() (no pinning if groups is empty).
+struct thread_placement {
+    struct group {
+        int node;               // the NUMA node (-1 if not associated with one)
+        std::vector<int> cpus;
+    };
+    std::vector<group> groups;
+
+    // all workers are pinned to the given CPUs
+    static thread_placement on_cpus(std::vector<int> cpus) {
+        thread_placement r;
+        r.groups.push_back(group{-1, std::move(cpus)});
+        return r;
+    }
+
+    // Workers are laid out over the NUMA nodes in a round-robin
+    // manner, each pinned to the CPUs of its node. There is no
+    // pinning if the NUMA topology is not available.
+    static thread_placement per_numa_node() {
+        thread_placement r;
+        for (auto& nd: numa_nodes()) {
+            r.groups.push_back(group{nd.id, std::move(nd.cpus)});
+        }
+        return r;
+    }
+};
+
+
+// The priority levels of tasks in a thread_pool
+enum class task_priority {
+    high = 0,
+    normal = 1,
+    low = 2
+};
+
+constexpr size_t num_task_priorities = 3;
+
+
+// Define CLUE_THREAD_POOL_STATS before including this header to have
+// each worker of a thread_pool record the statistics below (and to make
+// thread_pool::stats() and thread_pool::reset_stats() available).
+//
 class thread_pool {
+public:
+    typedef std::chrono::steady_clock::time_point deadline_t;
+
+    // a worker spawned or retired by an elastic pool
+    struct resize_event {
+        enum reason_t {
+            queue_depth,   // spawned as too many tasks were waiting
+            wait_latency,  // spawned as a task had waited too long
+            idle_timeout   // retired after being idle for too long
+        };
+        reason_t reason;
+        size_t worker;     // the index of the worker
+        size_t nthreads;   // the number of workers after the event
+    };
+
+    // The options of an elastic pool. A worker is spawned (up to
+    // max_threads) when no worker is idle and either more than
+    // queue_threshold tasks are waiting or the oldest one has waited
+    // longer than wait_threshold (0 disables this). These conditions are
+    // checked when tasks are scheduled and when a worker takes a task.
+    // A worker that has been idle for idle_timeout is retired (down to
+    // min_threads).
+    struct elastic_options {
+        size_t min_threads = 1;
+        size_t max_threads = std::thread::hardware_concurrency();
+        size_t queue_threshold = 1;
+        std::chrono::microseconds wait_threshold{0};
+        std::chrono::milliseconds idle_timeout{1000};
+        // called upon each resize event, outside the pool's lock
+        std::function<void(const resize_event&)> on_resize;
+    };
+
+#ifdef CLUE_THREAD_POOL_STATS
+    struct worker_stats {
+        // bin 0 counts waits shorter than 1 usec, bin k counts waits in
+        // [2^(k-1), 2^k) usecs, and the last bin counts all longer waits
+        static constexpr size_t num_wait_bins = 24;
+
+        size_t tasks_run;    // # tasks that have been started
+        duration run_time;   // total time spent running tasks
+        duration idle_time;  // total time spent waiting for tasks
+        std::array<size_t, num_wait_bins> wait_hist;  // enqueue-to-start latency
+
+        worker_stats() : tasks_run(0) {
+            wait_hist.fill(0);
+        }
+    };
+#endif
+
 private:
     typedef std::mutex mutex_type;
-    typedef std::function<void(size_t)> task_func_t;
-    typedef std::queue<task_func_t> task_queue_t;
+    // tasks are move-only and stored inline when small, so that
+    // scheduling small callables does not allocate memory (larger
+    // ones are stored in blocks from the object pool)
+    typedef task_function<void(size_t), 64, pool_allocator<char>> task_func_t;
+
+    struct queued_task_t {
+        task_func_t fn;
+        // the time of enqueue (only recorded by an elastic pool
+        // with a wait threshold)
+        std::chrono::steady_clock::time_point enq;
+#ifdef CLUE_THREAD_POOL_STATS
+        stop_watch sw;   // started upon enqueue
+#endif
+
+        template<class F,
+                 CLUE_REQUIRE(!std::is_same<typename std::decay<F>::type, queued_task_t>::value)>
+        explicit queued_task_t(F&& f)
+            : fn(std::forward<F>(f)) {
+#ifdef CLUE_THREAD_POOL_STATS
+            sw.start();
+#endif
+        }
+    };
+    typedef details::task_ring<queued_task_t> task_queue_t;
+
+    struct deadline_task_t {
+        deadline_t deadline;
+        size_t seq;        // to keep FIFO order among equal deadlines
+        queued_task_t t;
+
+        template<class F>
+        deadline_task_t(deadline_t d, size_t s, F&& f)
+            : deadline(d), seq(s), t(std::forward<F>(f)) {}
+    };
+
+#ifdef CLUE_THREAD_POOL_STATS
+    // The statistics of a worker, only accessed under the pool's mutex,
+    // except t_fin, which the worker sets without the lock when it
+    // finishes a task (a task with t_fin >= run_t0 has finished).
+    struct stats_rec_t {
+        typedef std::chrono::steady_clock clock_t;
+
+        size_t n_run = 0;
+        bool running = false;
+        bool idling = false;
+        clock_t::time_point run_t0;  // when the last task started
+        clock_t::duration run_total = clock_t::duration::zero();
+        std::atomic<clock_t::rep> t_fin{0};
+        stop_watch idle_sw;
+        std::array<size_t, worker_stats::num_wait_bins> wait_hist;
+
+        stats_rec_t() {
+            wait_hist.fill(0);
+        }
+
+        // the run time of the last task, up to now if still running
+        clock_t::duration last_run_() const {
+            clock_t::time_point t(clock_t::duration(t_fin.load()));
+            if (t < run_t0) t = clock_t::now();
+            return t - run_t0;
+        }
+
+        // count the run time of the last task if it has finished
+        void settle_() {
+            if (running && t_fin.load() >= run_t0.time_since_epoch().count()) {
+                run_total += last_run_();
+                running = false;
+            }
+        }
+
+        void on_start(const duration& wait) {
+            double us = wait.usecs();
+            size_t k = 0;
+            while (k + 1 < worker_stats::num_wait_bins && us >= 1.0) {
+                us *= 0.5;
+                ++k;
+            }
+            wait_hist[k] ++;
+            n_run ++;
+            settle_();
+            running = true;
+            run_t0 = clock_t::now();
+        }
+
+        // called by the worker itself, without the lock
+        void on_finish() {
+            t_fin.store(clock_t::now().time_since_epoch().count());
+        }
+
+        void begin_idle() {
+            idling = true;
+            idle_sw.start();
+        }
+
+        void end_idle() {
+            idle_sw.stop();
+            idling = false;
+        }
+
+        worker_stats snapshot() const {
+            worker_stats r;
+            r.tasks_run = n_run;
+            r.run_time = std::chrono::duration_cast<
+                std::chrono::high_resolution_clock::duration>(
+                    running ? run_total + last_run_() : run_total);
+            r.idle_time = idle_sw.elapsed();
+            r.wait_hist = wait_hist;
+            return r;
+        }
+
+        // clear the records, a running task or an ongoing
+        // wait is measured from now on
+        void reset() {
+            settle_();
+            n_run = 0;
+            wait_hist.fill(0);
+            run_total = clock_t::duration::zero();
+            idle_sw.reset();
+            if (running) run_t0 = clock_t::now();
+            if (idling) idle_sw.start();
+        }
+    };
+#endif
 
     struct th_entry_t {
         size_t idx;
         std::thread th;
         bool stopped;
+        bool retired;   // retired by an elastic pool
+#ifdef CLUE_THREAD_POOL_STATS
+        stats_rec_t rec;
+#endif
 
         template<class F>
         th_entry_t(size_t i, F&& f)
             : idx(i)
             , th(f)
-            , stopped(false) {}
+            , stopped(false)
+            , retired(false) {}
 
         void join() {
             if (th.joinable()) th.join();
@@ -41,15 +466,31 @@ private:
     };
 
     std::vector<std::unique_ptr<th_entry_t>> entries_;
-    task_queue_t tsk_queue_;
+    thread_placement placement_;
+    // one queue per priority level
+    task_queue_t queues_[num_task_priorities];
+    // lanes_[g] holds the normal-priority tasks that prefer the
+    // workers of group g
+    std::vector<std::unique_ptr<task_queue_t>> lanes_;
+    // the earliest-deadline-first lane (a min-heap on deadlines)
+    std::vector<deadline_task_t> edf_;
+    size_t n_queued_ = 0;  // total # tasks in all queues and lanes
+    size_t n_idle_ = 0;    // # workers waiting for tasks
+    size_t starvation_limit_ = 16;
+    size_t skips_[1 + num_task_priorities] = {};
 
     struct state_t {
-        size_t n_pushed = 0;
-        size_t n_completed = 0;
-        size_t sync_count = 0;
-        bool closed = false;
-        bool done = false;
-        bool stopped = false;
+        // the counters are atomic, so that completing a task does
+        // not take the lock unless someone is synchronizing
+        std::atomic<size_t> n_pushed{0};
+        std::atomic<size_t> n_completed{0};
+        std::atomic<size_t> n_cleared{0};   // # tasks removed by clear_tasks()
+        std::atomic<size_t> sync_count{0};  // # threads in synchronize()
+        // the lifecycle flags are only modified with the lock held,
+        // but can be read without it
+        std::atomic<bool> closed{false};
+        std::atomic<bool> done{false};
+        std::atomic<bool> stopped{false};
 
         void revive() {
             closed = false;
@@ -63,6 +504,13 @@ private:
     };
     state_t st_;
 
+    // elastic mode: the slots of retired workers are kept in entries_
+    // (and reused when spawning), their threads are joined later
+    bool elastic_ = false;
+    elastic_options eopts_;
+    size_t n_retired_ = 0;
+    std::vector<std::thread> retired_threads_;
+
     mutable mutex_type mut_;
     std::condition_variable cv_; // general notification
     std::condition_variable cv_c_; // notified upon completion of a task
@@ -74,14 +522,52 @@ public:
         resize(nthreads);
     }
 
+    thread_pool(size_t nthreads, thread_placement pl)
+        : placement_(std::move(pl)) {
+        init_lanes_();
+        resize(nthreads);
+    }
+
+    // Construct an elastic pool, which starts with opts.min_threads
+    // workers, and grows and shrinks with the load.
+    explicit thread_pool(const elastic_options& opts,
+                         thread_placement pl = thread_placement())
+        : placement_(std::move(pl))
+        , elastic_(true)
+        , eopts_(opts) {
+        if (eopts_.max_threads < eopts_.min_threads)
+            eopts_.max_threads = eopts_.min_threads;
+        if (eopts_.max_threads == 0)
+            eopts_.max_threads = 1;
+        init_lanes_();
+        std::lock_guard<mutex_type> lk(mut_);
+        for (size_t i = 0; i < eopts_.min_threads; ++i) add_thread(i);
+    }
+
+    bool elastic() const noexcept {
+        return elastic_;
+    }
+
+    const thread_placement& placement() const noexcept {
+        return placement_;
+    }
+
     bool empty() const {
         std::lock_guard<mutex_type> lk(mut_);
-        return entries_.empty();
+        return size_() == 0;
     }
 
+    // the number of (live) workers
     size_t size() const {
         std::lock_guard<mutex_type> lk(mut_);
-        return entries_.size();
+        return size_();
+    }
+
+    // The number of workers that work can be spread over, namely the
+    // maximum number of workers for an elastic pool (which grows as
+    // the work is queued), and the number of workers otherwise.
+    size_t concurrency() const {
+        return elastic_ ? eopts_.max_threads : size();
     }
 
     const std::thread& get_thread(size_t idx) const {
@@ -95,39 +581,56 @@ public:
     }
 
     size_t num_scheduled_tasks() const {
-        std::lock_guard<mutex_type> lk(mut_);
-        return st_.n_pushed;
+        return st_.n_pushed.load();
     }
 
     size_t num_completed_tasks() const {
-        std::lock_guard<mutex_type> lk(mut_);
-        return st_.n_completed;
+        return st_.n_completed.load();
     }
 
     // "closed" means no new task can be scheduled
     bool closed() const {
-        std::lock_guard<mutex_type> lk(mut_);
-        return st_.closed;
+        return st_.closed.load();
     }
 
     // "done" means all scheduled tasks have been done
     bool done() const {
-        std::lock_guard<mutex_type> lk(mut_);
-        return st_.done;
+        return st_.done.load();
     }
 
     // "stopped" means stopped manually by calling "stop()"
     bool stopped() const {
+        return st_.stopped.load();
+    }
+
+#ifdef CLUE_THREAD_POOL_STATS
+    // a snapshot of the statistics of each worker (the time
+    // of a running task or an ongoing wait is included)
+    std::vector<worker_stats> stats() const {
+        std::lock_guard<mutex_type> lk(mut_);
+        std::vector<worker_stats> r;
+        r.reserve(entries_.size());
+        for (auto& pe: entries_) r.push_back(pe->rec.snapshot());
+        return r;
+    }
+
+    void reset_stats() {
         std::lock_guard<mutex_type> lk(mut_);
-        return st_.stopped;
+        for (auto& pe: entries_) pe->rec.reset();
     }
+#endif
 
 public:
     void resize(size_t nthreads) {
-        if (nthreads == entries_.size())
-            return;
+        if (elastic_) {
+            throw std::runtime_error(
+                "thread_pool::resize: "
+                "An elastic pool cannot be resized manually.");
+        }
         {
             std::lock_guard<mutex_type> lk(mut_);
+            if (nthreads == entries_.size())
+                return;
             resize_(nthreads);
         }
         cv_.notify_all();
@@ -135,47 +638,164 @@ public:
 
     template<class F>
     auto schedule(F&& f) -> std::future<decltype(f((size_t)0))> {
-        if (st_.closed) {
-            throw std::runtime_error(
-                "thread_pool::schedule: "
-                "Cannot schedule while the thread_pool is closed.");
+        return schedule(task_priority::normal, std::forward<F>(f));
+    }
+
+    // Schedule a task at the given priority level. Higher levels are
+    // served first, subject to the starvation guard.
+    template<class F>
+    auto schedule(task_priority p, F&& f) -> std::future<decltype(f((size_t)0))> {
+        auto pt = make_packaged_(std::forward<F>(f));
+        auto fut = pt.get_future();
+        enqueue_("thread_pool::schedule", p, -1, std::move(pt));
+        return fut;
+    }
+
+    // Schedule a task to the earliest-deadline-first lane, which is
+    // served before all priority levels. Tasks in this lane are run
+    // in the order of their deadlines (a missed deadline does not
+    // cancel a task).
+    template<class F>
+    auto schedule_before(deadline_t deadline, F&& f) -> std::future<decltype(f((size_t)0))> {
+        auto pt = make_packaged_(std::forward<F>(f));
+        auto fut = pt.get_future();
+        resize_event ev;
+        bool grown = false;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            check_schedulable_("thread_pool::schedule_before");
+            edf_.emplace_back(deadline, st_.n_pushed.load(), std::move(pt));
+            stamp_(edf_.back().t);
+            std::push_heap(edf_.begin(), edf_.end(), edf_later_);
+            grown = on_pushed_(1, ev);
         }
-        if (st_.sync_count > 0) {
-            throw std::runtime_error(
-                "thread_pool::schedule: "
-                "Cannot schedule while other threads are synchronizing the pool.");
+        notify_pushed_(1, grown, ev);
+        return fut;
+    }
+
+    // Schedule a task that prefers to run on a worker on the given
+    // NUMA node. Other workers take it only when they have nothing
+    // else to do. The hint is ignored if no worker is on that node.
+    template<class F>
+    auto schedule_on(int node, F&& f) -> std::future<decltype(f((size_t)0))> {
+        auto pt = make_packaged_(std::forward<F>(f));
+        auto fut = pt.get_future();
+        enqueue_("thread_pool::schedule_on", task_priority::normal, node, std::move(pt));
+        return fut;
+    }
+
+    // Schedule a task without creating a future (fire-and-forget).
+    //
+    // f is stored directly in the task queue, so no memory is allocated
+    // when f is small enough to be stored inline. As with std::thread,
+    // an exception that escapes f terminates the program.
+    template<class F>
+    void post(F&& f) {
+        post(task_priority::normal, std::forward<F>(f));
+    }
+
+    template<class F>
+    void post(task_priority p, F&& f) {
+        enqueue_("thread_pool::post", p, -1, std::forward<F>(f));
+    }
+
+    // post a task with a NUMA node hint (see schedule_on)
+    template<class F>
+    void post_on(int node, F&& f) {
+        enqueue_("thread_pool::post_on", task_priority::normal, node, std::forward<F>(f));
+    }
+
+    // The starvation guard: when tasks of a level have been passed
+    // over by this many tasks of higher levels, the next task is
+    // taken from that level. 0 disables the guard.
+    size_t starvation_limit() const {
+        std::lock_guard<mutex_type> lk(mut_);
+        return starvation_limit_;
+    }
+
+    void set_starvation_limit(size_t n) {
+        std::lock_guard<mutex_type> lk(mut_);
+        starvation_limit_ = n;
+    }
+
+    // Schedule f(tidx, i) for each i in [first, last).
+    //
+    // The whole range is represented by a single descriptor. A few
+    // runner tasks (at most one per thread) are pushed at once, each
+    // repeatedly claims a chunk of indices from the descriptor.
+    // When chunk is 0, it is determined based on concurrency().
+    template<class Index, class F>
+    bulk_handle schedule_bulk(Index first, Index last, F&& f, size_t chunk=0) {
+        static_assert(std::is_integral<Index>::value,
+            "thread_pool::schedule_bulk: Index must be an integral type.");
+        check_schedulable_("thread_pool::schedule_bulk");  // fail early
+
+        size_t n = last > first ? static_cast<size_t>(last - first) : 0;
+        size_t nthreads = concurrency();
+        if (chunk == 0) {
+            chunk = n / (4 * (nthreads > 0 ? nthreads : 1));
+            if (chunk == 0) chunk = 1;
         }
-        
-        using pck_task_t = std::packaged_task<decltype(f((size_t)0))(size_t)>;
-        auto sp = std::make_shared<pck_task_t>(std::forward<F>(f));
+        using state_t = details::bulk_state<Index, typename std::decay<F>::type>;
+        auto sp = std::allocate_shared<state_t>(pool_allocator<state_t>(),
+            first, n, chunk, std::forward<F>(f));
+        if (n == 0) return bulk_handle(sp);
+
+        size_t nchunks = (n + chunk - 1) / chunk;
+        size_t nrunners = nthreads < nchunks ? nthreads : nchunks;
+        if (nrunners == 0) nrunners = 1;
+        resize_event ev;
+        bool grown = false;
         {
             std::lock_guard<mutex_type> lk(mut_);
-            tsk_queue_.emplace([sp](size_t idx){
-                (*sp)(idx);
-            });
-            st_.n_pushed ++;
+            check_schedulable_("thread_pool::schedule_bulk");
+            task_queue_t& q = queue_for_(task_priority::normal, -1);
+            for (size_t i = 0; i < nrunners; ++i) {
+                q.emplace([sp](size_t idx){
+                    sp->run(idx);
+                });
+                stamp_(q.back());
+            }
+            grown = on_pushed_(nrunners, ev);
         }
-        cv_.notify_one();
-        return sp->get_future();
+        notify_pushed_(nrunners, grown, ev);
+        return bulk_handle(sp);
+    }
+
+    // Apply f(tidx, x) to each element x of a random-access range
+    // (e.g. value_range, array_view, fast_vector, std::vector), and
+    // block until all have been processed.
+    //
+    // Note: it should not be called from a task running on the same
+    // pool, as it blocks the calling thread.
+    template<class Range, class F>
+    void parallel_for(Range&& rng, size_t chunk, F&& f) {
+        auto first = std::begin(rng);
+        size_t n = static_cast<size_t>(std::distance(first, std::end(rng)));
+        schedule_bulk(size_t(0), n, [first, &f](size_t tidx, size_t i){
+            f(tidx, first[i]);
+        }, chunk).wait();
+    }
+
+    template<class Range, class F>
+    void parallel_for(Range&& rng, F&& f) {
+        parallel_for(std::forward<Range>(rng), 0, std::forward<F>(f));
     }
 
     // synchronize:
     // block until all current tasks have been finished
     // but it does not close the quque
     void synchronize() {
+        if (all_completed_()) return;
         std::unique_lock<mutex_type> lk(mut_);
-        if (st_.n_completed < st_.n_pushed) {
-            st_.sync_count ++;
-            cv_c_.wait(lk, [this](){
-                return st_.n_completed == st_.n_pushed;
-            });
-            st_.sync_count --;
-        }
+        st_.sync_count ++;
+        cv_c_.wait(lk, [this](){ return all_completed_(); });
+        st_.sync_count --;
     }
 
     // close the queue, so no new tasks can be added
     void close(bool stop_cmd=false) {
-        if (st_.closed) return;
+        if (st_.closed.load() && (!stop_cmd || st_.stopped.load())) return;
         {
             std::lock_guard<mutex_type> lk(mut_);
             st_.closed = true;
@@ -202,10 +822,19 @@ public:
         for (auto& pe: entries_) {
             pe->join();
         }
+        std::vector<std::thread> ths;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            ths.swap(retired_threads_);
+        }
+        for (auto& th: ths) {
+            th.join();
+        }
 
         std::lock_guard<mutex_type> lk2(mut_);
-        st_.done = tsk_queue_.empty();
+        st_.done = (n_queued_ == 0);
         entries_.clear();
+        n_retired_ = 0;
     }
 
     // block until all tasks finish
@@ -225,33 +854,278 @@ public:
         bool to_notify = false;
         {
             std::lock_guard<mutex_type> lk(mut_);
-            to_notify = !tsk_queue_.empty();
-            while (!tsk_queue_.empty()) {
-                tsk_queue_.pop();
-            }
+            to_notify = (n_queued_ > 0);
+            for (auto& q: queues_) q.clear();
+            for (auto& q: lanes_) q->clear();
+            edf_.clear();
+            st_.n_cleared += n_queued_;
+            n_queued_ = 0;
         }
         if (to_notify)
             cv_.notify_all();
     }
 
 private:
+    // A closed pool keeps its workers until no task is queued or running,
+    // as running tasks may still post tasks (see check_schedulable_),
+    // which should be spread over the workers rather than left to the
+    // worker that posts them.
     bool can_thread_exit(const th_entry_t& e) {
         return e.stopped ||
-            (tsk_queue_.empty() && st_.closed);
+            (n_queued_ == 0 && st_.closed && all_finished_());
     }
 
-    bool try_pop_task(size_t th_idx, task_func_t& f) {
-        std::lock_guard<mutex_type> lk(mut_);
-        const th_entry_t& e = *(entries_.at(th_idx));
-        if (can_thread_exit(e)) return false;
+    // the pool that the calling thread works for (if any)
+    static const thread_pool*& current_pool_() {
+        static thread_local const thread_pool* p = nullptr;
+        return p;
+    }
 
-        if (!tsk_queue_.empty()) {
-            f = std::move(tsk_queue_.front());
-            tsk_queue_.pop();
-            return true;
+#ifdef CLUE_THREAD_POOL_STATS
+    // the record of the calling worker, set whenever it takes the lock
+    // to get a task (the entries are heap-allocated, so its address is
+    // stable, while entries_ itself may be reallocated meanwhile)
+    static stats_rec_t*& own_rec_() {
+        static thread_local stats_rec_t* p = nullptr;
+        return p;
+    }
+#endif
+
+    // Tasks running on the pool can always schedule new tasks (e.g. the
+    // continuations of themselves), which are counted before the tasks
+    // themselves complete, and hence are waited for by synchronize()
+    // and join().
+    //
+    // This is called with the lock held when a task is pushed, as the
+    // flags are only changed with the lock held, no task can be pushed
+    // once close() has returned.
+    void check_schedulable_(const char *fname) const {
+        if (current_pool_() == this) return;
+        if (st_.closed) {
+            throw std::runtime_error(std::string(fname) + ": "
+                "Cannot schedule while the thread_pool is closed.");
+        }
+        if (st_.sync_count > 0) {
+            throw std::runtime_error(std::string(fname) + ": "
+                "Cannot schedule while other threads are synchronizing the pool.");
+        }
+    }
+
+    template<class F>
+    static std::packaged_task<typename std::result_of<F&(size_t)>::type(size_t)>
+    make_packaged_(F&& f) {
+        using R = typename std::result_of<F&(size_t)>::type;
+        return std::packaged_task<R(size_t)>(std::forward<F>(f));
+    }
+
+    template<class G>
+    void enqueue_(const char *fname, task_priority p, int node, G&& g) {
+        resize_event ev;
+        bool grown = false;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            check_schedulable_(fname);
+            task_queue_t& q = queue_for_(p, node);
+            q.emplace(std::forward<G>(g));
+            stamp_(q.back());
+            grown = on_pushed_(1, ev);
+        }
+        notify_pushed_(1, grown, ev);
+    }
+
+    // record the time of enqueue, if the pool may grow upon wait latency
+    void stamp_(queued_task_t& t) const {
+        if (elastic_ && eopts_.wait_threshold.count() > 0)
+            t.enq = std::chrono::steady_clock::now();
+    }
+
+    // Count n tasks just pushed (with the lock held). All pushes go
+    // through here, so that an elastic pool can spawn a worker for them.
+    bool on_pushed_(size_t n, resize_event& ev) {
+        n_queued_ += n;
+        st_.n_pushed += n;
+        return elastic_ && try_grow_(ev);
+    }
+
+    // wake up workers for n pushed tasks (after the lock is released)
+    void notify_pushed_(size_t n, bool grown, const resize_event& ev) {
+        if (n > 1) cv_.notify_all(); else cv_.notify_one();
+        if (grown) after_grow_(ev);
+    }
+
+    size_t size_() const noexcept {
+        return entries_.size() - n_retired_;
+    }
+
+    void init_lanes_() {
+        for (size_t g = 0; g < placement_.groups.size(); ++g) {
+            lanes_.emplace_back(new task_queue_t());
+        }
+    }
+
+    // the longest time that a waiting task has waited (with the lock held)
+    std::chrono::steady_clock::duration oldest_wait_() {
+        using clock_t = std::chrono::steady_clock;
+        clock_t::time_point t0 = clock_t::time_point::max();
+        auto check = [&t0](task_queue_t& q) {
+            if (!q.empty() && q.front().enq != clock_t::time_point() &&
+                q.front().enq < t0) t0 = q.front().enq;
+        };
+        for (auto& q: queues_) check(q);
+        for (auto& l: lanes_) check(*l);
+        // the deadline lane is checked at the task to run next
+        if (!edf_.empty() && edf_.front().t.enq != clock_t::time_point() &&
+            edf_.front().t.enq < t0) t0 = edf_.front().t.enq;
+        return t0 == clock_t::time_point::max() ?
+            clock_t::duration::zero() : clock_t::now() - t0;
+    }
+
+    // Spawn a worker if the load requires (with the lock held). This is
+    // checked whenever tasks are pushed, and whenever a worker takes a
+    // task. There is no timer: a backlog whose workers are all blocked
+    // in long-running tasks does not grow the pool until the next push.
+    bool try_grow_(resize_event& ev) {
+        size_t n = size_();
+        if (st_.closed || n >= eopts_.max_threads) return false;
+        if (n == 0 || (n_idle_ == 0 && n_queued_ > eopts_.queue_threshold)) {
+            ev.reason = resize_event::queue_depth;
+        } else if (n_idle_ == 0 && eopts_.wait_threshold.count() > 0 &&
+                   oldest_wait_() > eopts_.wait_threshold) {
+            ev.reason = resize_event::wait_latency;
         } else {
             return false;
         }
+
+        // reuse the slot of a retired worker if any
+        size_t i = 0;
+        while (i < entries_.size() && !entries_[i]->retired) ++i;
+        if (i < entries_.size()) {
+            retired_threads_.push_back(std::move(entries_[i]->th));
+            n_retired_ --;
+        }
+        add_thread(i);
+        ev.worker = i;
+        ev.nthreads = n + 1;
+        return true;
+    }
+
+    void after_grow_(const resize_event& ev) {
+        std::vector<std::thread> ths;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            ths.swap(retired_threads_);
+        }
+        for (auto& th: ths) th.join();
+        if (eopts_.on_resize) eopts_.on_resize(ev);
+    }
+
+    // The queue for a task of priority p, with a node hint (with the
+    // lock held). The hint only applies to the normal priority.
+    task_queue_t& queue_for_(task_priority p, int node) {
+        if (p == task_priority::normal && node >= 0) {
+            size_t ng = placement_.groups.size();
+            for (size_t g = 0; g < ng && g < entries_.size(); ++g) {
+                if (placement_.groups[g].node == node) return *lanes_[g];
+            }
+        }
+        return queues_[static_cast<size_t>(p)];
+    }
+
+    static bool edf_later_(const deadline_task_t& a, const deadline_task_t& b) {
+        return a.deadline > b.deadline ||
+            (a.deadline == b.deadline && a.seq > b.seq);
+    }
+
+    // Levels, from the highest to the lowest: 0 is the deadline lane,
+    // and 1 + p for priority p (the normal one includes the node lanes).
+    static constexpr size_t num_levels_ = 1 + num_task_priorities;
+
+    bool level_empty_(size_t lv) const {
+        if (lv == 0) return edf_.empty();
+        if (!queues_[lv - 1].empty()) return false;
+        if (lv - 1 == static_cast<size_t>(task_priority::normal)) {
+            for (auto& l: lanes_) {
+                if (!l->empty()) return false;
+            }
+        }
+        return true;
+    }
+
+    // Choose a level to take a task from (with the lock held, and
+    // n_queued_ > 0): the lowest starved level if any, otherwise the
+    // highest non-empty one.
+    size_t choose_level_() {
+        size_t lv = num_levels_;
+        if (starvation_limit_ > 0) {
+            for (size_t k = num_levels_; k-- > 1;) {
+                if (skips_[k] >= starvation_limit_ && !level_empty_(k)) {
+                    lv = k;
+                    break;
+                }
+            }
+        }
+        if (lv == num_levels_) {
+            lv = 0;
+            while (level_empty_(lv)) ++lv;
+        }
+        CLUE_ASSERT(lv < num_levels_);
+        skips_[lv] = 0;
+        for (size_t k = lv + 1; k < num_levels_; ++k) {
+            if (level_empty_(k)) skips_[k] = 0; else skips_[k] ++;
+        }
+        return lv;
+    }
+
+    void take_(th_entry_t& e, queued_task_t& t, task_func_t& f) {
+        f = std::move(t.fn);
+#ifdef CLUE_THREAD_POOL_STATS
+        e.rec.on_start(t.sw.elapsed());
+#endif
+    }
+
+    // Move a task to f (with the lock held, and n_queued_ > 0). Within
+    // the normal level, it is taken from the worker's own lane, the
+    // common queue, or other lanes, in this order.
+    void pop_task_(th_entry_t& e, task_func_t& f) {
+        size_t lv = choose_level_();
+        if (lv == 0) {
+            std::pop_heap(edf_.begin(), edf_.end(), edf_later_);
+            take_(e, edf_.back().t, f);
+            edf_.pop_back();
+        } else {
+            task_queue_t *q = &queues_[lv - 1];
+            if (lv - 1 == static_cast<size_t>(task_priority::normal) && !lanes_.empty()) {
+                size_t g = e.idx % lanes_.size();
+                if (!lanes_[g]->empty()) {
+                    q = lanes_[g].get();
+                } else if (q->empty()) {
+                    for (auto& l: lanes_) {
+                        if (!l->empty()) { q = l.get(); break; }
+                    }
+                }
+            }
+            take_(e, q->front(), f);
+            q->pop();
+        }
+        n_queued_ --;
+    }
+
+    bool try_pop_task(size_t th_idx, task_func_t& f) {
+        resize_event ev;
+        bool grown = false;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            th_entry_t& e = *(entries_.at(th_idx));
+#ifdef CLUE_THREAD_POOL_STATS
+            own_rec_() = &e.rec;
+#endif
+            if (can_thread_exit(e) || n_queued_ == 0) return false;
+            pop_task_(e, f);
+            // the tasks left behind may have waited too long
+            grown = elastic_ && try_grow_(ev);
+        }
+        if (grown) after_grow_(ev);
+        return true;
     }
 
     // wait until:
@@ -260,23 +1134,80 @@ private:
     //
     bool wait_next_task(size_t th_idx, task_func_t& f) {
         std::unique_lock<mutex_type> lk(mut_);
-        const th_entry_t& e = *(entries_.at(th_idx));
-        cv_.wait(lk, [this,&e](){
-            return can_thread_exit(e) || !tsk_queue_.empty();
-        });
-        if (!e.stopped && !tsk_queue_.empty()) {
-            f = std::move(tsk_queue_.front());
-            tsk_queue_.pop();
+        th_entry_t& e = *(entries_.at(th_idx));
+#ifdef CLUE_THREAD_POOL_STATS
+        e.rec.begin_idle();
+#endif
+        auto ready = [this,&e](){
+            return can_thread_exit(e) || n_queued_ > 0;
+        };
+        n_idle_ ++;
+        bool retire = false;
+        for (;;) {
+            if (elastic_ && size_() > eopts_.min_threads) {
+                // an elastic pool retires the worker upon idle timeout
+                if (cv_.wait_for(lk, eopts_.idle_timeout, ready)) break;
+                if (size_() > eopts_.min_threads) {
+                    retire = true;
+                    break;
+                }
+            } else {
+                cv_.wait(lk, ready);
+                break;
+            }
+        }
+        n_idle_ --;
+#ifdef CLUE_THREAD_POOL_STATS
+        e.rec.end_idle();
+#endif
+        if (retire) {
+            e.retired = true;
+            n_retired_ ++;
+            resize_event ev{resize_event::idle_timeout, th_idx, size_()};
+            lk.unlock();
+            if (eopts_.on_resize) eopts_.on_resize(ev);
+            return false;
+        }
+        if (!e.stopped && n_queued_ > 0) {
+            pop_task_(e, f);
+            resize_event ev;
+            bool grown = elastic_ && try_grow_(ev);
+            lk.unlock();
+            if (grown) after_grow_(ev);
             return true;
         } else {
             return false;
         }
     }
 
-    void on_completed() {
-        std::lock_guard<mutex_type> lk(mut_);
+    // Both counters only grow, and n_completed never exceeds n_pushed.
+    // Hence, when a value of n_completed equals a later value of
+    // n_pushed, all tasks pushed so far had completed.
+    bool all_completed_() const {
+        size_t c = st_.n_completed.load();
+        return c == st_.n_pushed.load();
+    }
+
+    // like all_completed_, but the tasks removed by clear_tasks()
+    // are also counted as finished
+    bool all_finished_() const {
+        size_t c = st_.n_completed.load() + st_.n_cleared.load();
+        return c == st_.n_pushed.load();
+    }
+
+    void on_completed(size_t th_idx) {
+#ifdef CLUE_THREAD_POOL_STATS
+        own_rec_()->on_finish();
+#endif
+        // synchronize() raises sync_count before checking
+        // (see details::notify_parked)
         st_.n_completed ++;
-        cv_c_.notify_all();
+        details::notify_parked(st_.sync_count, mut_, cv_c_);
+        // the last task of a closed pool lets the idle workers exit
+        if (st_.closed && all_finished_()) {
+            { std::lock_guard<mutex_type> lk(mut_); }
+            cv_.notify_all();
+        }
     }
 
     void resize_(size_t nthreads) {
@@ -286,7 +1217,7 @@ private:
             size_t na = nthreads - n0;
             entries_.reserve(nthreads);
             for (size_t i = 0; i < na; ++i)
-                add_thread();
+                add_thread(entries_.size());
             st_.revive();
 
         } else if (nthreads < n0) {
@@ -303,9 +1234,16 @@ private:
         CLUE_ASSERT(entries_.size() == nthreads);
     }
 
-    void add_thread() {
-        size_t th_idx = entries_.size();
-        entries_.emplace_back(new th_entry_t(th_idx, [this, th_idx](){
+    // start a worker at slot th_idx (a new slot at the back,
+    // or the slot of a retired worker whose thread has been moved out)
+    void add_thread(size_t th_idx) {
+        std::vector<int> cpus;
+        if (!placement_.groups.empty()) {
+            cpus = placement_.groups[th_idx % placement_.groups.size()].cpus;
+        }
+        std::unique_ptr<th_entry_t> pe(new th_entry_t(th_idx, [this, th_idx, cpus](){
+            if (!cpus.empty()) pin_this_thread(cpus);
+            current_pool_() = this;
             task_func_t tfun;
             bool got_tsk = this->try_pop_task(th_idx, tfun);
             for(;;) {
@@ -313,7 +1251,7 @@ private:
                 // remain in the task queue
                 while (got_tsk) {
                     tfun(th_idx);
-                    this->on_completed();
+                    this->on_completed(th_idx);
                     got_tsk = this->try_pop_task(th_idx, tfun);
                 }
                 // wait for new task or a signal to stop
@@ -324,11 +1262,111 @@ private:
                 }
             }
         }));
+        if (th_idx < entries_.size()) {
+            entries_[th_idx] = std::move(pe);
+        } else {
+            entries_.push_back(std::move(pe));
+        }
     }
 
 }; // end class thread_pool
 
 
+// A group of tasks scheduled to a thread_pool, which one can wait for
+// without waiting for other tasks in the pool. Several groups can be
+// waited for on the same pool at the same time.
+//
+// The destructor waits for all tasks in the group.
+//
+class task_group {
+private:
+    // shared with the tasks, as a task may still be finishing
+    // its update when the waiter sees the group done
+    struct state_t {
+        concurrent_counter pending;
+        std::mutex ex_mut;
+        std::exception_ptr ex;
+
+        void set_exception(std::exception_ptr e) {
+            std::lock_guard<std::mutex> lk(ex_mut);
+            if (!ex) ex = std::move(e);
+        }
+    };
+
+    template<class F>
+    struct task_t {
+        std::shared_ptr<state_t> st;
+        F f;
+
+        void operator()(size_t tidx) {
+            try {
+                f(tidx);
+            } catch (...) {
+                st->set_exception(std::current_exception());
+            }
+            st->pending.dec();
+        }
+    };
+
+    thread_pool& pool_;
+    std::shared_ptr<state_t> st_;
+
+public:
+    explicit task_group(thread_pool& pool)
+        : pool_(pool)
+        , st_(std::make_shared<state_t>()) {}
+
+    task_group(const task_group&) = delete;
+    task_group& operator=(const task_group&) = delete;
+
+    ~task_group() {
+        st_->pending.wait(0L);
+    }
+
+    // the number of tasks that have not completed
+    size_t size() const {
+        return static_cast<size_t>(st_->pending.get());
+    }
+
+    // schedule f(tidx) as a task of the group
+    template<class F>
+    void post(F&& f) {
+        post(task_priority::normal, std::forward<F>(f));
+    }
+
+    template<class F>
+    void post(task_priority p, F&& f) {
+        using D = typename std::decay<F>::type;
+        st_->pending.inc();
+        try {
+            pool_.post(p, task_t<D>{st_, std::forward<F>(f)});
+        } catch (...) {
+            st_->pending.dec();
+            throw;
+        }
+    }
+
+    // Block until all tasks in the group have completed, and re-throw
+    // the first exception (if any) thrown by them. The group can be
+    // reused afterwards.
+    void wait() {
+        st_->pending.wait(0L);
+        std::exception_ptr e;
+        {
+            std::lock_guard<std::mutex> lk(st_->ex_mut);
+            e = st_->ex;
+            st_->ex = nullptr;
+        }
+        if (e) std::rethrow_exception(e);
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period>& dur) {
+        return st_->pending.wait_for(0L, dur);
+    }
+};
+
+
 }
 
 #endif
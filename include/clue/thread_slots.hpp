@@ -0,0 +1,53 @@
+/**
+ * @file thread_slots.hpp
+ *
+ * Helpers for structures that spread their state over per-thread,
+ * cache-line-padded slots (e.g. sharded_counter, rcu_domain).
+ */
+
+#ifndef CLUE_THREAD_SLOTS__
+#define CLUE_THREAD_SLOTS__
+
+#include <clue/common.hpp>
+#include <atomic>
+#include <thread>
+
+namespace clue {
+namespace details {
+
+// A value padded to a cache line, so that slots updated by
+// different threads do not share cache lines. The value is
+// value-initialized (e.g. atomic counters start from zero).
+template<class T>
+struct padded_slot {
+    static_assert(sizeof(T) < CLUE_CACHELINE_SIZE,
+        "padded_slot: the value must be smaller than a cache line.");
+
+    T v;
+    char pad_[CLUE_CACHELINE_SIZE - sizeof(T)];
+
+    padded_slot() : v() {}
+};
+
+// The number of slots, rounded up to a power of two (so that a thread
+// index maps to a slot with a mask). By default, it is the number of
+// hardware threads.
+inline size_t round_slots(size_t n) {
+    if (n == 0) n = std::thread::hardware_concurrency();
+    size_t c = 1;
+    while (c < n) c <<= 1;
+    return c;
+}
+
+// each thread is assigned a fixed index (in a round-robin manner)
+// the first time it touches any structure with per-thread slots
+inline size_t thread_slot_index() {
+    static std::atomic<size_t> next(0);
+    static thread_local size_t idx = next.fetch_add(1, std::memory_order_relaxed);
+    return idx;
+}
+
+} // end namespace details
+}
+
+#endif
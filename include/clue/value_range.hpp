@@ -124,7 +124,7 @@ public:
     }
 
     constexpr T operator[](difference_type n) const noexcept {
-        return Traits::advance(v_, n);
+        return Traits::next(v_, n);
     }
 
     // increment & decrement
@@ -224,7 +224,7 @@ public:
     }
 
     constexpr T operator[](difference_type n) const noexcept {
-        return Traits::advance(v_, step_(n));
+        return Traits::next(v_, step_(n));
     }
 
     // increment & decrement
@@ -0,0 +1,502 @@
+/**
+ * @file work_stealing_pool.hpp
+ *
+ * A thread pool where each worker owns a task deque and
+ * steals from the others when its own deque runs empty.
+ */
+
+#ifndef CLUE_WORK_STEALING_POOL__
+#define CLUE_WORK_STEALING_POOL__
+
+#include <clue/common.hpp>
+#include <clue/task_function.hpp>
+#include <clue/object_pool.hpp>
+#include <clue/spin_wait.hpp>
+#include <clue/thread_slots.hpp>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <vector>
+#include <deque>
+#include <stdexcept>
+
+namespace clue {
+
+class work_stealing_pool {
+private:
+    typedef std::mutex mutex_type;
+    // as in thread_pool, small callables are stored inline
+    typedef task_function<void(size_t), 64, pool_allocator<char>> task_func_t;
+
+    struct th_entry_t {
+        size_t idx;
+        std::thread th;
+        std::atomic<bool> stopped;
+
+        explicit th_entry_t(size_t i)
+            : idx(i)
+            , stopped(false) {}
+
+        void join() {
+            if (th.joinable()) th.join();
+        }
+    };
+
+    // the task deque owned by a worker:
+    // the owner pushes/pops at the back,
+    // while the others steal from the front
+    struct worker_queue_t {
+        mutex_type mut;
+        std::deque<task_func_t> tasks;
+        char pad_[CLUE_CACHELINE_SIZE];
+    };
+    typedef std::vector<worker_queue_t*> queue_table_t;
+
+    // the worker (if any) that the calling thread is running
+    struct worker_tls_t {
+        const work_stealing_pool *pool;
+        size_t idx;
+    };
+
+    std::vector<std::unique_ptr<th_entry_t>> entries_;
+
+    // worker queues are never destroyed before the pool,
+    // a queue whose owner has gone away is drained by stealing
+    std::vector<std::unique_ptr<worker_queue_t>> queues_;
+    std::vector<std::unique_ptr<queue_table_t>> tables_;
+    std::atomic<const queue_table_t*> table_;
+
+    std::atomic<size_t> n_queued_;   // # tasks sitting in the queues
+    std::atomic<size_t> n_pushed_;
+    std::atomic<size_t> n_completed_;
+    std::atomic<size_t> n_cleared_;  // # tasks removed by clear_tasks()
+    std::atomic<size_t> n_idle_;     // # workers waiting on cv_
+    std::atomic<size_t> n_producing_; // # pushes from outside in progress
+    std::atomic<size_t> sync_count_;
+    // the lifecycle flags are only modified with mut_ held,
+    // but can be read without it
+    std::atomic<bool> closed_;
+    std::atomic<bool> stopped_;
+    std::atomic<bool> done_;
+
+    mutable mutex_type mut_;
+    std::condition_variable cv_;   // notified when tasks arrive or threads should exit
+    std::condition_variable cv_c_; // notified upon completion of a task
+
+public:
+    work_stealing_pool()
+        : table_(nullptr)
+        , n_queued_(0)
+        , n_pushed_(0)
+        , n_completed_(0)
+        , n_cleared_(0)
+        , n_idle_(0)
+        , n_producing_(0)
+        , sync_count_(0)
+        , closed_(false)
+        , stopped_(false)
+        , done_(false) {}
+
+    explicit work_stealing_pool(size_t nthreads)
+        : work_stealing_pool() {
+        resize(nthreads);
+    }
+
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+    ~work_stealing_pool() {
+        if (!closed_) close(true);
+        for (auto& pe: entries_) pe->join();
+    }
+
+    bool empty() const {
+        std::lock_guard<mutex_type> lk(mut_);
+        return entries_.empty();
+    }
+
+    size_t size() const {
+        std::lock_guard<mutex_type> lk(mut_);
+        return entries_.size();
+    }
+
+    const std::thread& get_thread(size_t idx) const {
+        std::lock_guard<mutex_type> lk(mut_);
+        return entries_.at(idx)->th;
+    }
+
+    std::thread& get_thread(size_t idx) {
+        std::lock_guard<mutex_type> lk(mut_);
+        return entries_.at(idx)->th;
+    }
+
+    size_t num_scheduled_tasks() const {
+        return n_pushed_.load();
+    }
+
+    size_t num_completed_tasks() const {
+        return n_completed_.load();
+    }
+
+    // "closed" means no new task can be scheduled from outside
+    bool closed() const {
+        return closed_.load();
+    }
+
+    // "done" means all scheduled tasks have been done
+    bool done() const {
+        return done_.load();
+    }
+
+    // "stopped" means stopped manually by calling "stop()"
+    bool stopped() const {
+        return stopped_.load();
+    }
+
+    // the index of the worker of this pool that is running
+    // the calling thread, or -1 if the caller is not one of them
+    size_t current_worker() const {
+        const worker_tls_t& t = tls_();
+        return t.pool == this ? t.idx : static_cast<size_t>(-1);
+    }
+
+public:
+    void resize(size_t nthreads) {
+        std::vector<std::unique_ptr<th_entry_t>> retired;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            if (nthreads == entries_.size())
+                return;
+            resize_(nthreads, retired);
+        }
+        cv_.notify_all();
+        for (auto& pe: retired) pe->join();
+    }
+
+    // Tasks scheduled from within a running task of this pool go to
+    // the worker's own deque, and are allowed even when the pool is
+    // closed or being synchronized (they are part of the current work).
+    //
+    // Tasks from outside go to the deque picked by the thread slot of
+    // the caller (see thread_slots.hpp), so that different producers
+    // seldom push to the same deque. They do not take mut_: a push is
+    // announced in n_producing_ before the flags are checked, and
+    // close() and synchronize() wait for the announced pushes, so none
+    // can slip in after they have begun.
+    template<class F>
+    auto schedule(F&& f) -> std::future<decltype(f((size_t)0))> {
+        using R = decltype(f((size_t)0));
+        std::packaged_task<R(size_t)> pt(std::forward<F>(f));
+        auto fut = pt.get_future();
+        enqueue_(std::move(pt));
+        return fut;
+    }
+
+    // Schedule a task without creating a future (fire-and-forget).
+    // As with thread_pool::post, no memory is allocated when f is small
+    // enough to be stored inline, and an exception that escapes f
+    // terminates the program.
+    template<class F>
+    void post(F&& f) {
+        enqueue_(std::forward<F>(f));
+    }
+
+    // synchronize:
+    // block until all current tasks have been finished
+    // but it does not close the quque
+    void synchronize() {
+        std::unique_lock<mutex_type> lk(mut_);
+        sync_count_ ++;
+        cv_c_.wait(lk, [this](){
+            return n_producing_.load() == 0 &&
+                n_completed_.load() == n_pushed_.load();
+        });
+        sync_count_ --;
+    }
+
+    // close the pool, so no new tasks can be added from outside
+    void close(bool stop_cmd=false) {
+        if (closed_ && !stop_cmd) return;
+        {
+            std::unique_lock<mutex_type> lk(mut_);
+            closed_ = true;
+            if (stop_cmd) {
+                stopped_ = true;
+                for (auto& pe: entries_) pe->stopped = true;
+            }
+            // let the pushes that have passed the check finish
+            cv_c_.wait(lk, [this](){ return n_producing_.load() == 0; });
+        }
+        cv_.notify_all();
+    }
+
+    void close_and_stop() {
+        close(true);
+    }
+
+    // wait until all threads finish their jobs
+    // and then clear them
+    void join() {
+        if (!closed_) {
+            throw std::runtime_error(
+                "work_stealing_pool::join: "
+                "The pool cannot be joined while it is not closed.");
+        }
+        for (auto& pe: entries_) {
+            pe->join();
+        }
+
+        std::lock_guard<mutex_type> lk(mut_);
+        done_ = (n_queued_.load() == 0);
+        entries_.clear();
+    }
+
+    // block until all tasks finish
+    void wait_done() {
+        close();
+        join();
+    }
+
+    // block until all current tasks finish
+    // remaining tasks are all cleared
+    void stop_and_wait() {
+        close_and_stop();
+        join();
+    }
+
+    void clear_tasks() {
+        size_t nr = 0;
+        {
+            std::lock_guard<mutex_type> lk(mut_);
+            for (auto& q: queues_) {
+                std::lock_guard<mutex_type> qlk(q->mut);
+                nr += q->tasks.size();
+                q->tasks.clear();
+            }
+            n_queued_ -= nr;
+            n_cleared_ += nr;
+        }
+        if (nr > 0)
+            cv_.notify_all();
+    }
+
+private:
+    static worker_tls_t& tls_() {
+        static thread_local worker_tls_t t = {nullptr, 0};
+        return t;
+    }
+
+    template<class G>
+    void enqueue_(G&& g) {
+        task_func_t tf(std::forward<G>(g));
+        const worker_tls_t& t = tls_();
+        if (t.pool == this) {
+            n_pushed_ ++;
+            push_task_(*table_.load(), std::move(tf), t.idx);
+        } else {
+            n_producing_ ++;
+            try {
+                check_schedulable_();
+                const queue_table_t* tbl = table_.load();
+                if (!tbl) {
+                    // no worker has ever been created: park the task
+                    // on a queue that the first worker would take over
+                    std::lock_guard<mutex_type> lk(mut_);
+                    tbl = add_queues_(1);
+                }
+                n_pushed_ ++;
+                push_task_(*tbl, std::move(tf),
+                    details::thread_slot_index() % tbl->size());
+            } catch (...) {
+                leave_producing_();
+                throw;
+            }
+            leave_producing_();
+        }
+        details::notify_parked(n_idle_, mut_, cv_, false);
+    }
+
+    // The counterpart of the check in enqueue_ (a Dekker-style handshake,
+    // see details::notify_parked): close() and synchronize() set their
+    // flag before waiting for n_producing_ to drop to zero.
+    void leave_producing_() {
+        n_producing_ --;
+        if (closed_.load() || sync_count_.load() > 0) {
+            { std::lock_guard<mutex_type> lk(mut_); }
+            cv_.notify_all();
+            cv_c_.notify_all();
+        }
+    }
+
+    // (called after n_producing_ is raised)
+    void check_schedulable_() const {
+        if (closed_) {
+            throw std::runtime_error(
+                "work_stealing_pool::schedule: "
+                "Cannot schedule while the pool is closed.");
+        }
+        if (sync_count_ > 0) {
+            throw std::runtime_error(
+                "work_stealing_pool::schedule: "
+                "Cannot schedule while other threads are synchronizing the pool.");
+        }
+    }
+
+    // push a task to the deque of worker w
+    //
+    // n_queued_ is raised after the task is visible in the deque,
+    // and the caller wakes up a sleeping worker if there is one
+    void push_task_(const queue_table_t& tbl, task_func_t&& f, size_t w) {
+        worker_queue_t& q = *tbl[w];
+        {
+            std::lock_guard<mutex_type> lk(q.mut);
+            q.tasks.push_back(std::move(f));
+        }
+        n_queued_ ++;
+    }
+
+    // pop from the back of the own deque,
+    // or steal from the front of the others
+    bool try_get_task_(size_t th_idx, task_func_t& f) {
+        if (n_queued_.load() == 0) return false;
+        const queue_table_t& tbl = *table_.load();
+        size_t n = tbl.size();
+
+        worker_queue_t& q = *tbl[th_idx];
+        {
+            std::lock_guard<mutex_type> lk(q.mut);
+            if (!q.tasks.empty()) {
+                f = std::move(q.tasks.back());
+                q.tasks.pop_back();
+                n_queued_ --;
+                return true;
+            }
+        }
+
+        for (size_t k = 1; k < n; ++k) {
+            worker_queue_t& v = *tbl[(th_idx + k) % n];
+            std::lock_guard<mutex_type> lk(v.mut);
+            if (!v.tasks.empty()) {
+                f = std::move(v.tasks.front());
+                v.tasks.pop_front();
+                n_queued_ --;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // whether no task is queued, running, or being pushed from outside
+    // (the tasks removed by clear_tasks() are counted as finished)
+    bool quiescent_() const {
+        if (n_producing_.load() > 0 || n_queued_.load() > 0) return false;
+        size_t c = n_completed_.load() + n_cleared_.load();
+        return c == n_pushed_.load();
+    }
+
+    // wait until:
+    // - some tasks are available: return true, or
+    // - the thread should stop: return false
+    //
+    // A closed pool keeps its workers until it is quiescent, as running
+    // tasks may still push tasks, which should be stolen by the others.
+    bool wait_for_work_(const th_entry_t& e) {
+        std::unique_lock<mutex_type> lk(mut_);
+        n_idle_ ++;
+        cv_.wait(lk, [this,&e](){
+            return e.stopped || n_queued_.load() > 0 ||
+                (closed_.load() && quiescent_());
+        });
+        n_idle_ --;
+        return !e.stopped && n_queued_.load() > 0;
+    }
+
+    void on_completed() {
+        n_completed_ ++;
+        details::notify_parked(sync_count_, mut_, cv_c_);
+        // the last task of a closed pool lets the idle workers exit
+        if (closed_.load() && quiescent_()) {
+            { std::lock_guard<mutex_type> lk(mut_); }
+            cv_.notify_all();
+        }
+    }
+
+    // create queues so that there are at least n of them,
+    // and publish a new queue table (requires mut_ being locked)
+    const queue_table_t* add_queues_(size_t n) {
+        const queue_table_t* tbl = table_.load();
+        if (queues_.size() < n) {
+            while (queues_.size() < n) {
+                queues_.emplace_back(new worker_queue_t());
+            }
+            queue_table_t* t = new queue_table_t();
+            for (auto& q: queues_) t->push_back(q.get());
+            // old tables are retained, as workers may still be scanning them
+            tables_.emplace_back(t);
+            table_.store(t);
+            tbl = t;
+        }
+        return tbl;
+    }
+
+    void resize_(size_t nthreads, std::vector<std::unique_ptr<th_entry_t>>& retired) {
+        size_t n0 = entries_.size();
+        if (nthreads > n0) {
+            // grow the thread pool
+            add_queues_(nthreads);
+            entries_.reserve(nthreads);
+            closed_ = false;
+            stopped_ = false;
+            done_ = false;
+            for (size_t i = n0; i < nthreads; ++i)
+                add_thread(i);
+
+        } else if (nthreads < n0) {
+            if (!(stopped_ || closed_)) {
+                throw std::runtime_error(
+                    "work_stealing_pool::resize: "
+                    "The pool can be shrinked only when closed or stopped.");
+            }
+            // the queues of the retired threads remain in the table,
+            // so their tasks can still be stolen by others
+            while (entries_.size() > nthreads) {
+                entries_.back()->stopped = true;
+                retired.push_back(std::move(entries_.back()));
+                entries_.pop_back();
+            }
+        }
+        CLUE_ASSERT(entries_.size() == nthreads);
+    }
+
+    void add_thread(size_t th_idx) {
+        th_entry_t *pe = new th_entry_t(th_idx);
+        entries_.emplace_back(pe);
+        pe->th = std::thread([this, pe](){
+            size_t th_idx = pe->idx;
+            worker_tls_t& t = tls_();
+            t.pool = this;
+            t.idx = th_idx;
+
+            task_func_t tfun;
+            for(;;) {
+                // execute the tasks in its own deque,
+                // and then whatever can be stolen from others
+                while (!pe->stopped && this->try_get_task_(th_idx, tfun)) {
+                    tfun(th_idx);
+                    tfun = nullptr;
+                    this->on_completed();
+                }
+                // wait for new task or a signal to stop
+                if (!wait_for_work_(*pe)) return;
+            }
+        });
+    }
+
+}; // end class work_stealing_pool
+
+}
+
+#endif
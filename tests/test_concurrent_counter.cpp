@@ -1,5 +1,7 @@
 #include <clue/concurrent_counter.hpp>
+#include <atomic>
 #include <thread>
+#include <vector>
 
 void test_basics() {
     clue::concurrent_counter cc_n;
@@ -8,7 +10,7 @@ void test_basics() {
     assert(0 == cc_n.get());
     assert(0 == cc_a.get());
 
-    bool stop = false;
+    std::atomic<bool> stop(false);
     std::thread worker([&](){
         long i = 0;
         while (!stop) {
@@ -34,7 +36,61 @@ void test_basics() {
     assert(a == 55);
 }
 
+void test_concurrent_updates() {
+    const long nt = 4;
+    const long N = 100000;
+    clue::concurrent_counter cc(0);
+
+    // multiple waiters on different conditions
+    std::vector<std::thread> waiters;
+    for (long t = 0; t < nt; ++t) {
+        waiters.emplace_back([&cc,N,t](){
+            cc.wait( clue::ge((t + 1) * N) );
+        });
+    }
+
+    std::vector<std::thread> workers;
+    for (long t = 0; t < nt; ++t) {
+        workers.emplace_back([&cc,N](){
+            for (long i = 0; i < N; ++i) {
+                cc.inc(2);
+                cc.dec();
+            }
+        });
+    }
+
+    for (auto& th: workers) th.join();
+    for (auto& th: waiters) th.join();
+    assert(cc.get() == nt * N);
+
+    cc.set(nt * N);
+    cc.reset();
+    assert(cc.get() == 0);
+}
+
+void test_timed_wait() {
+    clue::concurrent_counter cc(5);
+
+    // already satisfied
+    assert(cc.wait_for(5L, std::chrono::milliseconds(1)));
+
+    // time out
+    assert(!cc.wait_for(clue::gt(5), std::chrono::milliseconds(10)));
+    assert(!cc.wait_until(6L,
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(10)));
+
+    // satisfied before time out
+    std::thread worker([&](){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        cc.inc();
+    });
+    assert(cc.wait_for(6L, std::chrono::seconds(10)));
+    worker.join();
+}
+
 int main() {
     test_basics();
+    test_concurrent_updates();
+    test_timed_wait();
     return 0;
 }
@@ -1,13 +1,16 @@
 #include <clue/concurrent_queue.hpp>
 #include <thread>
 #include <vector>
+#include <iterator>
+#include <stdexcept>
 #include <cstdio>
 
-void test_push_then_pop(size_t nt) {
-    std::printf("testing push_then_pop ...\n");
+template<class Queue>
+void test_push_then_pop(size_t nt, const char *qname) {
+    std::printf("testing push_then_pop (%s) ...\n", qname);
     assert(nt > 0);
 
-    clue::concurrent_queue<int> Q;
+    Queue Q;
     int N = 10000;
 
     assert(Q.empty());
@@ -51,12 +54,13 @@ void test_push_then_pop(size_t nt) {
     assert(total == expect_total);
 }
 
-void test_concurrent_push_and_pop(size_t nt) {
-    std::printf("testing concurrent_push_and_pop with %lu threads ...\n", nt);
+template<class Queue>
+void test_concurrent_push_and_pop(size_t nt, const char *qname) {
+    std::printf("testing concurrent_push_and_pop with %lu threads (%s) ...\n", nt, qname);
 
     assert(nt > 0);
 
-    clue::concurrent_queue<int> Q;
+    Queue Q;
     int N = 100;
 
     std::vector<std::thread> producers;
@@ -95,12 +99,13 @@ void test_concurrent_push_and_pop(size_t nt) {
     assert(total == expect_total);
 }
 
-void test_concurrent_push_pop_empty(size_t nt) {
-    std::printf("testing concurrent_push_pop_empty with %lu threads ...\n", nt);
+template<class Queue>
+void test_concurrent_push_pop_empty(size_t nt, const char *qname) {
+    std::printf("testing concurrent_push_pop_empty with %lu threads (%s) ...\n", nt, qname);
 
     assert(nt > 0);
 
-    clue::concurrent_queue<int> Q;
+    Queue Q;
     int N = 100;
 
     std::vector<std::thread> producers;
@@ -153,10 +158,125 @@ void test_concurrent_push_pop_empty(size_t nt) {
     assert(total == expect_total);
 }
 
+template<class Queue>
+void test_close_and_timeout(const char *qname) {
+    std::printf("testing close and timed pops (%s) ...\n", qname);
+
+    Queue Q;
+    int v = 0;
+    assert(!Q.closed());
+
+    // timeout on an empty queue
+    auto t0 = std::chrono::steady_clock::now();
+    assert(!Q.wait_pop_for(v, std::chrono::milliseconds(20)));
+    assert(std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(20));
+    assert(!Q.wait_pop_until(v, std::chrono::steady_clock::now()));
+
+    Q.push(1);
+    assert(Q.wait_pop_for(v, std::chrono::milliseconds(20)) && v == 1);
+    Q.push(2);
+    assert(Q.wait_pop(v) && v == 2);
+
+    // waiting consumers return empty upon close
+    const size_t nc = 4;
+    std::vector<std::thread> consumers;
+    std::vector<int> nrecv(nc, 0);
+    for (size_t t = 0; t < nc; ++t) {
+        int& r = nrecv[t];
+        consumers.emplace_back([&Q,&r,t](){
+            int x = 0;
+            if (t % 2 == 0) {
+                while (Q.wait_pop(x)) r += x;
+            } else {
+                while (Q.wait_pop_for(x, std::chrono::seconds(10))) r += x;
+            }
+        });
+    }
+    for (int i = 0; i < 100; ++i) Q.push(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Q.close();
+    for (auto& t: consumers) t.join();
+    int total = 0;
+    for (int r: nrecv) total += r;
+    assert(total == 100);
+    assert(Q.closed());
+
+    // no more pushes; waiting pops fail when closed and empty
+    bool caught = false;
+    try { Q.push(3); } catch (const std::runtime_error&) { caught = true; }
+    assert(caught);
+    caught = false;
+    try { Q.wait_pop(); } catch (const std::runtime_error&) { caught = true; }
+    assert(caught);
+    assert(!Q.wait_pop(v));
+
+    // a consumer blocked in wait_pop(dst) returns false upon close
+    // (the sleep only makes it likely to be blocked by then)
+    Queue Q2;
+    std::thread c([&Q2](){ int x; assert(!Q2.wait_pop(x)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    Q2.close();
+    c.join();
+}
+
+template<class Queue>
+void test_pop_all(const char *qname) {
+    std::printf("testing pop_all (%s) ...\n", qname);
+
+    Queue Q;
+    std::vector<int> out;
+    assert(Q.pop_all(std::back_inserter(out)) == 0);
+    assert(out.empty());
+
+    for (int i = 0; i < 10; ++i) Q.push(i);
+    assert(Q.pop_all(std::back_inserter(out)) == 10);
+    assert(Q.empty());
+    for (int i = 0; i < 10; ++i) assert(out[i] == i);
+
+    // items left in a closed queue can still be drained
+    Q.push(42);
+    Q.close();
+    out.clear();
+    assert(Q.pop_all(std::back_inserter(out)) == 1 && out[0] == 42);
+
+    // concurrent producers, a consumer draining in batches
+    Queue Q2;
+    const int N = 10000;
+    const size_t np = 4;
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < np; ++t) {
+        producers.emplace_back([&Q2](){
+            for (int i = 0; i < N; ++i) Q2.push(i + 1);
+        });
+    }
+    long total = 0;
+    size_t n = 0;
+    std::vector<int> batch;
+    while (n < np * N) {
+        batch.clear();
+        n += Q2.pop_all(std::back_inserter(batch));
+        for (int x: batch) total += x;
+    }
+    for (auto& t: producers) t.join();
+    assert(total == (long)np * N * (N + 1) / 2);
+}
+
+using blocking_queue = clue::concurrent_queue<int>;
+using spinning_queue = clue::concurrent_queue<int, std::deque<int>, clue::spin_then_park<>>;
+
 int main() {
     size_t nt = 4;
-    test_push_then_pop(nt);
-    test_concurrent_push_and_pop(nt);
-    test_concurrent_push_pop_empty(nt);
+    test_push_then_pop<blocking_queue>(nt, "blocking_wait");
+    test_concurrent_push_and_pop<blocking_queue>(nt, "blocking_wait");
+    test_concurrent_push_pop_empty<blocking_queue>(nt, "blocking_wait");
+
+    test_push_then_pop<spinning_queue>(nt, "spin_then_park");
+    test_concurrent_push_and_pop<spinning_queue>(nt, "spin_then_park");
+    test_concurrent_push_pop_empty<spinning_queue>(nt, "spin_then_park");
+
+    test_close_and_timeout<blocking_queue>("blocking_wait");
+    test_close_and_timeout<spinning_queue>("spin_then_park");
+    test_pop_all<blocking_queue>("blocking_wait");
+    test_pop_all<spinning_queue>("spin_then_park");
     return 0;
 }
@@ -0,0 +1,225 @@
+#include <clue/concurrent_ring_queue.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cstdio>
+
+void test_basics() {
+    std::printf("testing basics ...\n");
+
+    clue::concurrent_ring_queue<std::string> Q(5);
+    assert(Q.capacity() == 8);
+    assert(Q.empty());
+    assert(Q.size() == 0);
+
+    for (size_t i = 0; i < 8; ++i) {
+        assert(Q.try_push(std::to_string(i)));
+    }
+    assert(Q.full());
+    assert(Q.size() == 8);
+
+    // back-pressure: the argument is left untouched upon failure
+    std::string s("x");
+    assert(!Q.try_push(std::move(s)));
+    assert(s == "x");
+
+    // a capacity that cannot be rounded up is rejected
+    bool caught = false;
+    try {
+        clue::concurrent_ring_queue<int> Q2(std::numeric_limits<size_t>::max());
+    } catch (const std::length_error&) {
+        caught = true;
+    }
+    assert(caught);
+
+    std::string v;
+    for (size_t i = 0; i < 3; ++i) {
+        assert(Q.try_pop(v));
+        assert(v == std::to_string(i));
+    }
+    assert(Q.size() == 5);
+
+    // wrap around
+    for (size_t i = 8; i < 11; ++i) {
+        Q.push(std::to_string(i));
+    }
+    assert(Q.full());
+
+    for (size_t i = 3; i < 11; ++i) {
+        assert(Q.wait_pop() == std::to_string(i));
+    }
+    assert(Q.empty());
+    assert(!Q.try_pop(v));
+
+    Q.push(3, 'a');
+    Q.push("bb");
+    assert(Q.size() == 2);
+    Q.clear();
+    assert(Q.empty());
+}
+
+void test_concurrent_push_and_pop(size_t nt, size_t cap) {
+    std::printf("testing concurrent_push_and_pop with %zu threads (cap = %zu) ...\n",
+        nt, cap);
+
+    assert(nt > 0);
+
+    clue::concurrent_ring_queue<long> Q(cap);
+    long N = 20000;
+
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < nt; ++t) {
+        producers.emplace_back([&Q,N](){
+            for (long i = 0; i < N; ++i) {
+                Q.push(i + 1);
+            }
+        });
+    }
+
+    std::vector<std::thread> consumers;
+    std::vector<long> sums(nt, 0);
+    for (size_t t = 0; t < nt; ++t) {
+        long& s = sums[t];
+        consumers.emplace_back([&Q,N,&s]{
+            for (long i = 0; i < N; ++i) {
+                s += Q.wait_pop();
+            }
+        });
+    }
+
+    for (size_t t = 0; t < nt; ++t) {
+        producers.at(t).join();
+    }
+
+    long total = 0;
+    for (size_t t = 0; t < nt; ++t) {
+        consumers.at(t).join();
+        total += sums.at(t);
+    }
+
+    long expect_total = nt * (N * (N + 1) / 2);
+    assert(total == expect_total);
+    assert(Q.empty());
+}
+
+void test_try_push_and_wait_empty(size_t nt) {
+    std::printf("testing try_push_and_wait_empty with %zu threads ...\n", nt);
+
+    clue::concurrent_ring_queue<long> Q(16);
+    long N = 1000;
+
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < nt; ++t) {
+        producers.emplace_back([&Q,N](){
+            for (long i = 0; i < N; ++i) {
+                while (!Q.try_push(i + 1)) std::this_thread::yield();
+            }
+        });
+    }
+
+    long total = 0;
+    std::thread consumer([&Q,&total,N,nt]{
+        long v = 0;
+        for (long i = 0; i < N * static_cast<long>(nt); ++i) {
+            v = Q.wait_pop();
+            total += v;
+        }
+    });
+
+    for (size_t t = 0; t < nt; ++t) {
+        producers.at(t).join();
+    }
+    Q.wait_empty();
+    consumer.join();
+
+    assert(Q.empty());
+    assert(total == static_cast<long>(nt) * (N * (N + 1) / 2));
+}
+
+// an element type whose construction and moves may throw
+struct fragile {
+    enum { bad_ctor = -1, bad_move = 13 };
+    int v;
+
+    explicit fragile(int x) : v(x) {
+        if (x == bad_ctor) throw std::runtime_error("fragile: construction");
+    }
+    fragile(fragile&& r) : v(r.v) {
+        if (r.v == bad_move) throw std::runtime_error("fragile: move");
+    }
+    fragile& operator=(fragile&& r) {
+        if (r.v == bad_move) throw std::runtime_error("fragile: move");
+        v = r.v;
+        return *this;
+    }
+};
+
+template<class F>
+bool throws(F&& f) {
+    try {
+        f();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void test_exceptions() {
+    std::printf("testing exceptions from elements ...\n");
+
+    clue::concurrent_ring_queue<fragile> Q(4);
+
+    // a failed construction pushes nothing, and the slot is skipped
+    assert(Q.try_push(1));
+    assert(throws([&](){ Q.try_push(fragile::bad_ctor); }));
+    Q.push(2);
+    assert(throws([&](){ Q.push(fragile::bad_ctor); }));
+
+    fragile x(0);
+    assert(Q.try_pop(x) && x.v == 1);
+    assert(Q.try_pop(x) && x.v == 2);
+    assert(!Q.try_pop(x));
+    assert(Q.empty());
+
+    // a failed move pops the element anyway
+    Q.push(fragile::bad_move);
+    Q.push(3);
+    assert(throws([&](){ Q.try_pop(x); }));
+    assert(Q.wait_pop().v == 3);
+    Q.push(fragile::bad_move);
+    assert(throws([&](){ Q.wait_pop(); }));
+    assert(Q.empty());
+
+    // the queue remains usable through many rounds
+    for (int i = 0; i < 20; ++i) {
+        assert(throws([&](){ Q.push(fragile::bad_ctor); }));
+        assert(Q.try_push(100 + i));
+        assert(Q.try_pop(x) && x.v == 100 + i);
+    }
+    assert(Q.empty());
+    Q.wait_empty();
+
+    // a hole left at the tail does not keep the queue non-empty
+    // when no consumer is left to skip it
+    assert(Q.try_push(7));
+    std::thread waiter([&Q](){ Q.wait_empty(); });
+    assert(throws([&](){ Q.push(fragile::bad_ctor); }));
+    assert(Q.try_pop(x) && x.v == 7);
+    waiter.join();
+    assert(Q.empty() && Q.size() == 0);
+    assert(throws([&](){ Q.push(fragile::bad_ctor); }));
+    assert(Q.empty());
+    Q.wait_empty();
+}
+
+int main() {
+    size_t nt = 4;
+    test_basics();
+    test_concurrent_push_and_pop(nt, 4);
+    test_concurrent_push_and_pop(nt, 1024);
+    test_try_push_and_wait_empty(nt);
+    test_exceptions();
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include <clue/cpu_affinity.hpp>
+
+using namespace clue;
+
+TEST(CpuAffinity, ParseCpuList) {
+    using v_t = std::vector<int>;
+    ASSERT_EQ(v_t(), parse_cpu_list(""));
+    ASSERT_EQ(v_t(), parse_cpu_list("\n"));
+    ASSERT_EQ(v_t({3}), parse_cpu_list("3"));
+    ASSERT_EQ(v_t({0, 1, 2, 3}), parse_cpu_list("0-3\n"));
+    ASSERT_EQ(v_t({0, 1, 2, 3, 8, 10, 11}), parse_cpu_list("0-3,8,10-11"));
+    ASSERT_EQ(v_t({1, 5, 6}), parse_cpu_list(" 1, 5-6 "));
+
+    ASSERT_THROW(parse_cpu_list("a"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("1-"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("3-1"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("1;2"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("1,"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("1, "), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list("1,,2"), std::invalid_argument);
+    ASSERT_THROW(parse_cpu_list(",1"), std::invalid_argument);
+}
+
+TEST(CpuAffinity, NumaNodes) {
+    for (const numa_node& nd: numa_nodes()) {
+        ASSERT_GE(nd.id, 0);
+        ASSERT_FALSE(nd.cpus.empty());
+    }
+}
+
+TEST(CpuAffinity, PinThisThread) {
+    std::vector<int> cpus0 = this_thread_affinity();
+    if (cpus0.empty()) return;
+
+    std::vector<int> cpus(1, cpus0.back());
+    ASSERT_TRUE(pin_this_thread(cpus));
+    ASSERT_EQ(cpus, this_thread_affinity());
+
+    ASSERT_FALSE(pin_this_thread(std::vector<int>()));
+    ASSERT_FALSE(pin_this_thread(std::vector<int>(1, -1)));
+
+    // restore
+    ASSERT_TRUE(pin_this_thread(cpus0));
+    ASSERT_EQ(cpus0, this_thread_affinity());
+}
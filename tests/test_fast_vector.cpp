@@ -1086,3 +1086,161 @@ TYPED_TEST(FastVectorsTest, Resize_and_Shrink) {
         ENSURE_CLEANUP;
     }
 }
+
+
+// Val only holds a pointer, so it can be declared relocatable,
+// and then its vectors grow with realloc
+
+TEST(FastVectors, ReallocGrowth) {
+    using rvec = fast_vector<Val, 0, true>;
+    using rvec3 = fast_vector<Val, 3, true>;
+
+    RESET_OBJCOUNT
+    {
+        rvec a;
+        rvec3 b;
+        for (long i = 0; i < 5000; ++i) {
+            a.emplace_back(i);
+            b.emplace_back(i * 2);
+        }
+        ASSERT_EQ(5000, a.size());
+        ASSERT_EQ(5000, b.size());
+        ASSERT_EQ(10000, Val::count_object);
+        for (long i = 0; i < 5000; ++i) {
+            ASSERT_EQ(i, a[i].get());
+            ASSERT_EQ(i * 2, b[i].get());
+        }
+
+        a.reserve(100000);
+        ASSERT_GE(a.capacity(), 100000);
+        ASSERT_EQ(4999, a.back().get());
+
+        // shrink in place, then back to static storage
+        a.resize(10);
+        a.shrink_to_fit();
+        ASSERT_EQ(10, a.capacity());
+        ASSERT_EQ(9, a.back().get());
+
+        b.resize(2);
+        b.shrink_to_fit();
+        ASSERT_FALSE(b.use_dynamic());
+        ASSERT_EQ(2, b[1].get());
+
+        // copies and moves of malloc-ed blocks
+        rvec c(a);
+        rvec d(std::move(a));
+        ASSERT_TRUE(std::equal(c.begin(), c.end(), d.begin()));
+        a = std::move(c);
+        ASSERT_EQ(10, a.size());
+        ASSERT_EQ(5, a[5].get());
+    }
+    ENSURE_CLEANUP;
+
+    // large vectors of scalars
+    fast_vector<double> x;
+    for (size_t i = 0; i < 1000000; ++i) x.push_back(double(i));
+    ASSERT_EQ(1000000, x.size());
+    ASSERT_EQ(999999.0, x.back());
+    ASSERT_EQ(123456.0, x[123456]);
+}
+
+
+// a vector with static storage first moves its elements to a new
+// block, and then grows that block with realloc
+
+TEST(FastVectors, ReallocFromStatic) {
+    using rvec4 = fast_vector<Val, 4, true>;
+
+    RESET_OBJCOUNT
+    {
+        rvec4 a;
+        for (long i = 0; i < 4; ++i) a.emplace_back(i + 1);
+        ASSERT_FALSE(a.use_dynamic());
+        ASSERT_EQ(4, a.capacity());
+
+        // static -> dynamic
+        a.emplace_back(5);
+        ASSERT_TRUE(a.use_dynamic());
+        ASSERT_EQ(5, a.size());
+        ASSERT_GT(a.capacity(), 4);
+        ASSERT_EQ(5, Val::count_object);
+        for (long i = 0; i < 5; ++i) ASSERT_EQ(i + 1, a[i].get());
+
+        // dynamic -> dynamic, with realloc
+        size_t cap = a.capacity();
+        for (long i = 5; i < 1000; ++i) {
+            a.emplace_back(i + 1);
+            if (a.capacity() != cap) {
+                cap = a.capacity();
+                ASSERT_EQ(size_t(i + 1), a.size());
+                for (long j = 0; j <= i; ++j) ASSERT_EQ(j + 1, a[j].get());
+            }
+        }
+        ASSERT_GE(cap, 1000);
+        ASSERT_EQ(1000, Val::count_object);
+
+        a.reserve(50000);
+        ASSERT_GE(a.capacity(), 50000);
+        ASSERT_EQ(1000, a.size());
+        for (long i = 0; i < 1000; ++i) ASSERT_EQ(i + 1, a[i].get());
+    }
+    ENSURE_CLEANUP;
+}
+
+
+// relocatability of standard types
+
+static_assert(is_relocatable<std::unique_ptr<Val>>::value, "unique_ptr");
+static_assert(is_relocatable<std::unique_ptr<int[]>>::value, "unique_ptr<T[]>");
+static_assert(is_relocatable<std::shared_ptr<Val>>::value, "shared_ptr");
+static_assert(is_relocatable<std::weak_ptr<Val>>::value, "weak_ptr");
+static_assert(is_relocatable<std::pair<int, float>>::value, "pair");
+static_assert(is_relocatable<std::tuple<int, std::unique_ptr<Val>, double*>>::value, "tuple");
+static_assert(is_relocatable<std::array<std::shared_ptr<int>, 4>>::value, "array");
+static_assert(is_relocatable<fast_vector<Val>>::value, "fast_vector");
+static_assert(!is_relocatable<fast_vector<int, 4>>::value, "fast_vector with static storage");
+static_assert(!is_relocatable<std::pair<int, Val>>::value, "pair of non-relocatables");
+static_assert(!is_relocatable<std::tuple<int, Val>>::value, "tuple of non-relocatables");
+static_assert(!is_relocatable<Val>::value, "Val");
+#ifndef _GLIBCXX_DEBUG
+static_assert(is_relocatable<std::vector<Val>>::value, "vector");
+#endif
+
+TEST(FastVectors, RelocatableStdTypes) {
+    using uvec = fast_vector<std::unique_ptr<long>>;
+    static_assert(std::is_same<uvec, fast_vector<std::unique_ptr<long>, 0, true>>::value,
+        "relocatable by default");
+
+    uvec a;
+    for (long i = 0; i < 100; ++i) a.emplace_back(new long(i));
+    a.insert(a.begin(), std::unique_ptr<long>(new long(-1)));
+    a.erase(a.begin() + 10, a.begin() + 20);
+    ASSERT_EQ(91, a.size());
+    ASSERT_EQ(-1, *a[0]);
+    ASSERT_EQ(8, *a[9]);
+    ASSERT_EQ(19, *a[10]);
+    ASSERT_EQ(99, *a.back());
+
+    // nested vectors
+    fast_vector<fast_vector<long>> vv;
+    for (long i = 0; i < 50; ++i) {
+        vv.emplace_back(size_t(i), i);
+    }
+    vv.erase(vv.begin());
+    vv.insert(vv.begin() + 5, fast_vector<long>(3, 7L));
+    ASSERT_EQ(50, vv.size());
+    ASSERT_EQ(3, vv[5].size());
+    ASSERT_EQ(7, vv[5][2]);
+    ASSERT_EQ(49, vv.back().size());
+    ASSERT_EQ(49, vv.back().back());
+
+    fast_vector<std::pair<std::shared_ptr<long>, std::vector<long>>> ps;
+    for (long i = 0; i < 100; ++i) {
+        ps.emplace_back(std::make_shared<long>(i), std::vector<long>(3, i));
+    }
+    ps.erase(ps.begin() + 1);
+    ASSERT_EQ(99, ps.size());
+    ASSERT_EQ(2, *ps[1].first);
+    ASSERT_EQ(2, ps[1].second[2]);
+    ASSERT_EQ(1, ps[1].first.use_count());
+}
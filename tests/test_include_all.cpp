@@ -21,6 +21,11 @@ using clue::floats::is_nan;
 // memory
 using clue::aligned_alloc;
 using clue::aligned_free;
+using clue::monotonic_arena;
+using clue::arena_allocator;
+using clue::huge_page_allocator;
+using clue::object_pool;
+using clue::pool_allocator;
 
 // array_view
 using clue::array_view;
@@ -49,6 +54,7 @@ using clue::mparser;
 
 // fast_vector
 using clue::fast_vector;
+using clue::aligned_fast_vector;
 
 // ordered_dict
 using clue::ordered_dict;
@@ -83,17 +89,69 @@ using clue::type_name;
 
 // shared_mutex
 using clue::shared_mutex;
+using clue::basic_shared_mutex;
+using clue::distributed_shared_mutex;
 using clue::shared_timed_mutex;
 using clue::shared_lock;
 
+// rcu
+using clue::rcu_domain;
+using clue::rcu_cell;
+
+// seqlock
+using clue::seqlock;
+
+// lock_profiler
+using clue::lock_stats;
+using clue::lock_registry;
+
 // concurrent_queue
 using clue::concurrent_queue;
 
+// concurrent_ring_queue
+using clue::concurrent_ring_queue;
+using clue::spin_wait;
+using clue::blocking_wait;
+using clue::spin_then_park;
+
+// spsc_queue
+using clue::spsc_queue;
+
 // concurrent_counter
 using clue::concurrent_counter;
 
+// sharded_counter
+using clue::sharded_counter;
+
+// cpu_affinity
+using clue::parse_cpu_list;
+using clue::numa_nodes;
+using clue::pin_this_thread;
+
+// task_function
+using clue::task_function;
+
 // thread_pool
 using clue::thread_pool;
+using clue::thread_placement;
+using clue::task_priority;
+using clue::task_group;
+
+// task_graph
+using clue::task_handle;
+using clue::task_graph;
+using clue::when_all;
+using clue::when_any;
+
+// parallel_algorithms
+using clue::parallel_for_each;
+using clue::parallel_transform;
+using clue::parallel_reduce;
+using clue::parallel_scan;
+using clue::parallel_sort;
+
+// work_stealing_pool
+using clue::work_stealing_pool;
 
 int main() {
     return 0;
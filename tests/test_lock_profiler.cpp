@@ -0,0 +1,127 @@
+#define CLUE_LOCK_PROFILING
+#include <clue/shared_mutex.hpp>
+#include <clue/concurrent_queue.hpp>
+#include <thread>
+#include <future>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cassert>
+#include <cstdio>
+
+using namespace clue;
+
+void sleep_ms(size_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+const lock_stats& find_stats(const std::vector<lock_stats>& ss, const std::string& name) {
+    for (const auto& s: ss) {
+        if (s.name == name) return s;
+    }
+    assert(false);
+    return ss.front();
+}
+
+void test_shared_mutex_profile() {
+    std::printf("testing profiles of shared_mutex ...\n");
+    lock_registry& reg = lock_registry::instance();
+    size_t n0 = reg.size();
+    {
+        shared_mutex m;
+        m.set_name("config");
+        assert(reg.size() == n0 + 1);
+
+        // uncontended
+        m.lock(); m.unlock();
+        m.lock_shared(); m.unlock_shared();
+        assert(m.try_lock());
+        m.unlock();
+
+        lock_stats s = find_stats(reg.stats(), "config");
+        assert(s.address == &m);
+        assert(s.acquisitions == 3);
+        assert(s.contended == 0);
+        assert(s.wait_time.nsecs() == 0);
+
+        // a writer holds the lock for a while, a reader waits
+        // (the reader only tries once the writer holds the lock)
+        std::promise<void> locked;
+        std::thread w([&](){
+            unique_lock<shared_mutex> lk(m);
+            locked.set_value();
+            sleep_ms(30);
+        });
+        locked.get_future().wait();
+        {
+            shared_lock<shared_mutex> lk(m);
+        }
+        w.join();
+
+        s = find_stats(reg.stats(), "config");
+        assert(s.acquisitions == 5);
+        assert(s.contended == 1);
+        assert(s.wait_time.nsecs() > 0);
+        assert(s.max_hold_time.msecs() >= 20.0);
+
+        reg.reset();
+        s = find_stats(reg.stats(), "config");
+        assert(s.acquisitions == 0 && s.contended == 0);
+        assert(s.max_hold_time.nsecs() == 0);
+    }
+    assert(reg.size() == n0);
+}
+
+void test_queue_profile_and_dump() {
+    std::printf("testing profiles of concurrent_queue and dump ...\n");
+    lock_registry& reg = lock_registry::instance();
+
+    concurrent_queue<int> q1;
+    concurrent_queue<int, std::deque<int>, spin_then_park<>> q2;
+    shared_timed_mutex m3;
+    q1.set_name("jobs");
+    q2.set_name("results");
+    m3.set_name("idle");
+
+    // contention on q2: many threads pushing at once
+    std::vector<std::thread> ths;
+    for (int t = 0; t < 4; ++t) {
+        ths.emplace_back([&q2](){
+            for (int i = 0; i < 20000; ++i) q2.push(i);
+        });
+    }
+    for (auto& t: ths) t.join();
+
+    // a consumer that waits for an item: the wait on the condition
+    // is not counted as holding the lock
+    std::thread c([&q1](){ assert(q1.wait_pop() == 7); });
+    sleep_ms(30);
+    q1.push(7);
+    c.join();
+
+    std::vector<lock_stats> ss = reg.stats();
+    const lock_stats& s1 = find_stats(ss, "jobs");
+    const lock_stats& s2 = find_stats(ss, "results");
+    assert(s1.acquisitions == 2);
+    assert(s1.max_hold_time.msecs() < 25.0);
+    assert(s2.acquisitions == 80000);
+    assert(find_stats(ss, "idle").acquisitions == 0);
+
+    std::vector<lock_stats> top = reg.top_contended(2);
+    assert(top.size() == 2);
+    assert(top[0].contended >= top[1].contended);
+
+    std::ostringstream os;
+    reg.dump(os, 10);
+    std::string out = os.str();
+    assert(out.find("jobs") != std::string::npos);
+    assert(out.find("results") != std::string::npos);
+    assert(out.find("idle") != std::string::npos);
+    std::printf("%s", out.c_str());
+}
+
+int main() {
+    test_shared_mutex_profile();
+    test_queue_profile_and_dump();
+    return 0;
+}
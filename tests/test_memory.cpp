@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <clue/memory.hpp>
+#include <clue/fast_vector.hpp>
+#include <clue/keyed_vector.hpp>
+#include <clue/ordered_dict.hpp>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using namespace clue;
+
+inline bool is_aligned(const void *p, size_t a) {
+    return reinterpret_cast<std::uintptr_t>(p) % a == 0;
+}
+
+TEST(Memory, AlignedAlloc) {
+    void *p = clue::aligned_alloc(100, 64);
+    ASSERT_TRUE(p != nullptr);
+    ASSERT_TRUE(is_aligned(p, 64));
+    clue::aligned_free(p);
+}
+
+TEST(HugePageAllocator, Basics) {
+    using alloc_t = huge_page_allocator<float, 64>;
+    alloc_t a;
+    huge_page_allocator<double, 64> b(a);
+    ASSERT_TRUE(a == b);
+    ASSERT_EQ(64, alloc_t::alignment);
+    ASSERT_EQ(128, (huge_page_allocator<char, 128>::alignment));
+
+    // small requests
+    ASSERT_FALSE(alloc_t::uses_huge_pages(1000));
+    float *p = a.allocate(1000);
+    ASSERT_TRUE(is_aligned(p, 64));
+    for (int i = 0; i < 1000; ++i) p[i] = float(i);
+    ASSERT_EQ(999.0f, p[999]);
+    a.deallocate(p, 1000);
+
+    // large requests
+    size_t n = (huge_page_size * 3 + 100) / sizeof(float);
+    float *q = a.allocate(n);
+    if (alloc_t::uses_huge_pages(n)) {
+        ASSERT_TRUE(is_aligned(q, huge_page_size));
+    }
+    ASSERT_TRUE(is_aligned(q, 64));
+    for (size_t i = 0; i < n; i += 1024) q[i] = float(i);
+    q[n - 1] = 1.0f;
+    ASSERT_EQ(2048.0f, q[2048]);
+    a.deallocate(q, n);
+}
+
+TEST(HugePageAllocator, AlignedFastVector) {
+    aligned_fast_vector<float> v;
+    for (size_t i = 0; i < 2000000; ++i) v.push_back(float(i % 1000));
+    ASSERT_EQ(2000000, v.size());
+    ASSERT_TRUE(is_aligned(v.data(), 64));
+    ASSERT_EQ(999.0f, v[1999999]);
+
+    aligned_fast_vector<double, 128> w(10, 1.5);
+    ASSERT_TRUE(is_aligned(w.data(), 128));
+    w.shrink_to_fit();
+    ASSERT_EQ(1.5, w[9]);
+}
+
+TEST(MonotonicArena, Basics) {
+    monotonic_arena a(256);
+    ASSERT_EQ(0, a.num_chunks());
+    ASSERT_EQ(0, a.bytes_used());
+    ASSERT_EQ(0, a.bytes_reserved());
+
+    char *p1 = static_cast<char*>(a.allocate(10, 1));
+    char *p2 = static_cast<char*>(a.allocate(10, 1));
+    ASSERT_EQ(p1 + 10, p2);
+    ASSERT_EQ(1, a.num_chunks());
+    ASSERT_EQ(20, a.bytes_used());
+    ASSERT_EQ(256, a.bytes_reserved());
+
+    void *p3 = a.allocate(8, 8);
+    ASSERT_TRUE(is_aligned(p3, 8));
+    ASSERT_EQ(static_cast<void*>(p1 + 24), p3);
+
+    // over-aligned requests
+    void *p4 = a.allocate(1, 64);
+    ASSERT_TRUE(is_aligned(p4, 64));
+
+    // deallocate does nothing
+    a.deallocate(p3, 8);
+    ASSERT_EQ(1, a.num_chunks());
+}
+
+TEST(MonotonicArena, GrowthAndReset) {
+    monotonic_arena a(256);
+    void *first = nullptr;
+    for (int i = 0; i < 100; ++i) {
+        char *p = static_cast<char*>(a.allocate(40));
+        std::memset(p, i, 40);
+        if (i == 0) first = p;
+    }
+    ASSERT_EQ(4000, a.bytes_used());
+    size_t nc = a.num_chunks();
+    ASSERT_TRUE(nc > 1 && nc < 10);   // chunk sizes double
+
+    // a request larger than the next chunk gets its own
+    void *big = a.allocate(100000);
+    ASSERT_TRUE(big != nullptr);
+    ASSERT_EQ(nc + 1, a.num_chunks());
+    ASSERT_TRUE(a.bytes_reserved() > 100000);
+
+    // reset keeps the chunks, and reuses them from the oldest
+    size_t r = a.bytes_reserved();
+    a.reset();
+    ASSERT_EQ(0, a.bytes_used());
+    ASSERT_EQ(nc + 1, a.num_chunks());
+    ASSERT_EQ(r, a.bytes_reserved());
+    ASSERT_EQ(first, a.allocate(40));
+    for (int i = 1; i < 100; ++i) a.allocate(40);
+    ASSERT_EQ(big, a.allocate(100000));
+    ASSERT_EQ(nc + 1, a.num_chunks());
+    ASSERT_EQ(r, a.bytes_reserved());
+
+    // a request too large for any free chunk gets a new one,
+    // and the smaller free chunks are kept for reuse
+    a.reset();
+    void *huge = a.allocate(300000);
+    ASSERT_EQ(nc + 2, a.num_chunks());
+    ASSERT_TRUE(a.bytes_reserved() >= r + 300000);
+    ASSERT_EQ(first, a.allocate(40));
+    for (int i = 1; i < 100; ++i) a.allocate(40);
+    ASSERT_EQ(big, a.allocate(100000));
+    ASSERT_EQ(nc + 2, a.num_chunks());
+
+    // after a reset, a request skips the free chunks too small for it
+    r = a.bytes_reserved();
+    a.reset();
+    ASSERT_EQ(huge, a.allocate(300000));
+    ASSERT_EQ(first, a.allocate(40));
+    ASSERT_EQ(nc + 2, a.num_chunks());
+    ASSERT_EQ(r, a.bytes_reserved());
+
+    a.release();
+    ASSERT_EQ(0, a.num_chunks());
+    ASSERT_EQ(0, a.bytes_reserved());
+    ASSERT_TRUE(a.allocate(10) != nullptr);
+}
+
+TEST(ArenaAllocator, Basics) {
+    monotonic_arena a;
+    monotonic_arena b;
+    arena_allocator<int> ai(a);
+    arena_allocator<double> ad(ai);
+    arena_allocator<int> bi(b);
+
+    ASSERT_EQ(&a, &ad.arena());
+    ASSERT_TRUE(ai == ad);
+    ASSERT_TRUE(ai != bi);
+
+    int *p = ai.allocate(10);
+    for (int i = 0; i < 10; ++i) p[i] = i;
+    double *q = ad.allocate(3);
+    ASSERT_TRUE(is_aligned(q, alignof(double)));
+    ASSERT_EQ(static_cast<void*>(p + 10), static_cast<void*>(q));
+    ASSERT_EQ(10 * sizeof(int) + 3 * sizeof(double), a.bytes_used());
+    ai.deallocate(p, 10);
+    ASSERT_THROW(ai.allocate(ai.max_size() + 1), std::bad_alloc);
+}
+
+TEST(ArenaAllocator, FastVector) {
+    using vec_t = fast_vector<int, 4, true, arena_allocator<int>>;
+    monotonic_arena a;
+
+    vec_t v(a);
+    for (int i = 0; i < 4; ++i) v.push_back(i);
+    ASSERT_FALSE(v.use_dynamic());
+    ASSERT_EQ(0, a.bytes_used());
+
+    for (int i = 4; i < 1000; ++i) v.push_back(i);
+    ASSERT_TRUE(v.use_dynamic());
+    ASSERT_TRUE(a.bytes_used() >= 1000 * sizeof(int));
+    for (int i = 0; i < 1000; ++i) ASSERT_EQ(i, v[i]);
+
+    // copies and moves keep drawing from the arena
+    vec_t v2(v);
+    ASSERT_EQ(&a, &v2.get_allocator().arena());
+    ASSERT_EQ(v.size(), v2.size());
+    ASSERT_TRUE(std::equal(v.begin(), v.end(), v2.begin()));
+
+    vec_t v3(std::move(v2));
+    ASSERT_EQ(1000, v3.size());
+    ASSERT_EQ(999, v3.back());
+
+    using svec_t = fast_vector<std::string, 0, false, arena_allocator<std::string>>;
+    svec_t sv(a);
+    for (int i = 0; i < 100; ++i) sv.push_back(std::to_string(i));
+    ASSERT_EQ("42", sv[42]);
+}
+
+TEST(ArenaAllocator, KeyedVector) {
+    using alloc_t = arena_allocator<std::string>;
+    monotonic_arena a;
+
+    keyed_vector<std::string, int, std::hash<int>, alloc_t> kv{alloc_t(a)};
+    for (int i = 0; i < 200; ++i) kv.push_back(i, std::to_string(i * 2));
+    ASSERT_EQ(200, kv.size());
+    ASSERT_EQ("84", kv.by(42));
+    ASSERT_TRUE(kv.find(1000) == kv.end());
+    ASSERT_TRUE(a.bytes_used() > 200 * sizeof(std::string));
+
+    auto kv2 = kv;
+    ASSERT_TRUE(kv2 == kv);
+    ASSERT_EQ("398", kv2.by(199));
+}
+
+TEST(ArenaAllocator, OrderedDict) {
+    using alloc_t = arena_allocator<std::pair<std::string, int>>;
+    monotonic_arena a;
+
+    using dict_t = ordered_dict<std::string, int, std::hash<std::string>,
+                                std::equal_to<std::string>, alloc_t>;
+    {
+        dict_t d{alloc_t(a)};
+        for (int i = 0; i < 200; ++i) d[std::to_string(i)] = i;
+        ASSERT_EQ(200, d.size());
+        ASSERT_EQ(42, d.at("42"));
+        ASSERT_EQ("0", d.begin()->first);
+        ASSERT_TRUE(a.bytes_used() > 0);
+    }
+
+    // the memory is reused once the containers using it are gone
+    size_t r = a.bytes_reserved();
+    a.reset();
+    dict_t d{alloc_t(a)};
+    for (int i = 0; i < 200; ++i) d[std::to_string(i)] = i;
+    ASSERT_EQ(199, d.at("199"));
+    ASSERT_EQ(r, a.bytes_reserved());
+}
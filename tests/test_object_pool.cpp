@@ -0,0 +1,162 @@
+#include <clue/object_pool.hpp>
+#include <clue/keyed_vector.hpp>
+#include <clue/thread_pool.hpp>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+using clue::object_pool;
+using clue::pool_allocator;
+
+void test_basics() {
+    std::printf("testing object_pool basics ...\n");
+    object_pool& P = object_pool::instance();
+
+    assert(object_pool::size_class(1) == 0);
+    assert(object_pool::size_class(16) == 0);
+    assert(object_pool::size_class(17) == 1);
+    assert(object_pool::is_pooled(256, 8));
+    assert(!object_pool::is_pooled(257, 8));
+
+    // blocks freed on a thread are reused by it (LIFO)
+    void *p = P.allocate(24);
+    std::memset(p, 1, 24);
+    size_t c = P.cached(24);
+    P.deallocate(p, 24);
+    assert(P.cached(32) == c + 1);
+    assert(P.allocate(30) == p);
+
+    // blocks are aligned, and those of a class do not overlap
+    std::vector<char*> ps;
+    for (int i = 0; i < 1000; ++i) {
+        char *q = static_cast<char*>(P.allocate(32));
+        assert(reinterpret_cast<std::uintptr_t>(q) % 16 == 0);
+        std::memset(q, i & 0xff, 32);
+        ps.push_back(q);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        assert(ps[i][0] == (char)(i & 0xff) && ps[i][31] == (char)(i & 0xff));
+    }
+    for (char *q: ps) P.deallocate(q, 32);
+    P.deallocate(p, 24);
+
+    // a cache holds at most two batches (plus the one being freed)
+    assert(P.cached(32) <= 2 * object_pool::batch_size);
+
+    // large requests bypass the pool
+    void *big = P.allocate(1000);
+    P.deallocate(big, 1000);
+}
+
+void test_rebalancing() {
+    std::printf("testing object_pool rebalancing ...\n");
+    object_pool& P = object_pool::instance();
+    const size_t bs = 200;
+    const size_t n = 5000;
+
+    // blocks allocated by one thread and freed by another
+    // flow back through the depot
+    std::vector<void*> ps(n);
+    std::thread producer([&](){
+        for (size_t i = 0; i < n; ++i) ps[i] = P.allocate(bs);
+    });
+    producer.join();
+
+    size_t d0 = P.depot_size(bs);
+    std::thread consumer([&](){
+        for (size_t i = 0; i < n; ++i) P.deallocate(ps[i], bs);
+    });
+    consumer.join();
+
+    // the consumer has exited, so all blocks are back in the depot
+    assert(P.depot_size(bs) == d0 + n);
+
+    size_t ns = P.num_slabs();
+    std::thread producer2([&](){
+        for (size_t i = 0; i < n; ++i) ps[i] = P.allocate(bs);
+        for (size_t i = 0; i < n; ++i) P.deallocate(ps[i], bs);
+    });
+    producer2.join();
+    assert(P.num_slabs() == ns);
+}
+
+void test_concurrent() {
+    std::printf("testing object_pool under concurrency ...\n");
+    object_pool& P = object_pool::instance();
+    const int nt = 4;
+
+    std::vector<std::thread> ths;
+    for (int t = 0; t < nt; ++t) {
+        ths.emplace_back([&P, t](){
+            std::vector<std::pair<unsigned char*, size_t>> live;
+            unsigned r = 12345u + (unsigned)t;
+            for (int i = 0; i < 20000; ++i) {
+                r = r * 1103515245u + 12345u;
+                if (live.size() < 50 || (r >> 16) % 3 != 0) {
+                    size_t n = 1 + (r >> 8) % 256;
+                    auto *p = static_cast<unsigned char*>(P.allocate(n));
+                    std::memset(p, t + 1, n);
+                    live.emplace_back(p, n);
+                } else {
+                    size_t k = (r >> 4) % live.size();
+                    auto e = live[k];
+                    live[k] = live.back();
+                    live.pop_back();
+                    assert(e.first[0] == t + 1 && e.first[e.second - 1] == t + 1);
+                    P.deallocate(e.first, e.second);
+                }
+            }
+            for (auto& e: live) P.deallocate(e.first, e.second);
+        });
+    }
+    for (auto& th: ths) th.join();
+}
+
+void test_pool_allocator() {
+    std::printf("testing pool_allocator ...\n");
+
+    pool_allocator<int> a;
+    pool_allocator<double> b(a);
+    assert(a == b && !(a != b));
+
+    // keyed_vector default-constructs its allocators,
+    // including the rebound one of its index
+    clue::keyed_vector<std::string, int, std::hash<int>,
+                       pool_allocator<std::string>> kv;
+    for (int i = 0; i < 1000; ++i) kv.push_back(i, std::to_string(i));
+    assert(kv.size() == 1000);
+    assert(kv.by(123) == "123");
+
+    // nodes freed on another thread
+    std::list<int, pool_allocator<int>> lst;
+    for (int i = 0; i < 1000; ++i) lst.push_back(i);
+    std::thread th([&lst](){ lst.clear(); });
+    th.join();
+    assert(lst.empty());
+
+    // task records of the thread pool
+    clue::thread_pool tp(4);
+    std::atomic<long> s(0);
+    char buf[100] = {0};
+    buf[99] = 1;
+    for (int i = 0; i < 1000; ++i) {
+        tp.post([buf, &s](size_t){ s += buf[99]; });
+    }
+    tp.schedule_bulk(0, 1000, [&s](size_t, int){ s += 1; }).wait();
+    tp.wait_done();
+    assert(s.load() == 2000);
+}
+
+int main() {
+    test_basics();
+    test_rebalancing();
+    test_concurrent();
+    test_pool_allocator();
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <clue/parallel_algorithms.hpp>
+#include <clue/array_view.hpp>
+#include <clue/fast_vector.hpp>
+#include <clue/value_range.hpp>
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+
+using clue::thread_pool;
+
+void test_for_each_and_transform() {
+    std::printf("testing parallel_for_each and parallel_transform ...\n");
+    thread_pool P(4);
+
+    // uneven work: the cost of an element grows with its index
+    const size_t n = 1000;
+    std::vector<long> a(n, 0);
+    clue::array_view<long> av(a.data(), n);
+    clue::parallel_for_each(P, clue::vrange(n), [&a](size_t i){
+        long s = 0;
+        for (size_t k = 0; k < i * 10; ++k) s += (long)(k % 3);
+        a[i] = s + (long)i;
+    });
+    for (size_t i = 0; i < n; ++i) {
+        long s = 0;
+        for (size_t k = 0; k < i * 10; ++k) s += (long)(k % 3);
+        assert(a[i] == s + (long)i);
+    }
+
+    // in-place updates through an array_view, with an explicit grain
+    clue::parallel_for_each(P, av, [](long& x){ x = -x; }, 7);
+    assert(a[0] == 0 && a[n - 1] < 0);
+
+    clue::fast_vector<int> src;
+    for (int i = 0; i < 500; ++i) src.push_back(i);
+    std::vector<std::string> dst(src.size());
+    auto e = clue::parallel_transform(P, src, dst.begin(),
+        [](int x){ return std::to_string(x * 2); }, 16);
+    assert(e == dst.end());
+    for (int i = 0; i < 500; ++i) assert(dst[i] == std::to_string(i * 2));
+
+    // empty and single-element ranges
+    std::vector<int> empty;
+    clue::parallel_for_each(P, empty, [](int){ assert(false); });
+    std::vector<int> one(1, 3);
+    clue::parallel_transform(P, one, one.begin(), [](int x){ return x + 1; });
+    assert(one[0] == 4);
+
+    P.wait_done();
+}
+
+void test_reduce() {
+    std::printf("testing parallel_reduce ...\n");
+    thread_pool P(4);
+
+    long s = clue::parallel_reduce(P, clue::vrange(1L, 100001L), 0L);
+    assert(s == 100000L * 100001L / 2);
+
+    s = clue::parallel_reduce(P, clue::vrange(1L, 100001L), 10L, 999);
+    assert(s == 100000L * 100001L / 2 + 10);
+
+    // non-commutative: the order of chunks is kept
+    clue::fast_vector<std::string> words;
+    for (int i = 0; i < 200; ++i) words.push_back(std::to_string(i % 10));
+    std::string expect;
+    for (const auto& w: words) expect += w;
+    std::string r = clue::parallel_reduce(P, words, std::string(">"),
+        [](const std::string& x, const std::string& y){ return x + y; }, 13);
+    assert(r == ">" + expect);
+
+    std::vector<int> empty;
+    assert(clue::parallel_reduce(P, empty, 5) == 5);
+
+    P.wait_done();
+}
+
+void test_scan() {
+    std::printf("testing parallel_scan ...\n");
+    thread_pool P(4);
+
+    for (size_t n: {0, 1, 5, 64, 1000, 10007}) {
+        std::vector<long> a(n);
+        for (size_t i = 0; i < n; ++i) a[i] = (long)(i % 17) - 5;
+        std::vector<long> expect(n);
+        std::partial_sum(a.begin(), a.end(), expect.begin());
+
+        for (size_t g: {0, 1, 3, 100}) {
+            std::vector<long> out(n);
+            auto e = clue::parallel_scan(P, a, out.begin(), g);
+            assert(e == out.end());
+            assert(out == expect);
+        }
+
+        // in place, over an array_view
+        std::vector<long> b(a);
+        clue::array_view<long> bv(b.data(), n);
+        clue::parallel_scan(P, bv, bv.begin(), 10);
+        assert(b == expect);
+    }
+
+    // with a custom op
+    std::vector<long> out(20);
+    clue::parallel_scan(P, clue::vrange(1L, 21L), out.begin(),
+        [](long x, long y){ return x * y % 1000003L; }, 3);
+    long f = 1;
+    for (long i = 1; i <= 20; ++i) {
+        f = f * i % 1000003L;
+        assert(out[i - 1] == f);
+    }
+
+    P.wait_done();
+}
+
+void test_sort() {
+    std::printf("testing parallel_sort ...\n");
+    thread_pool P(4);
+    std::mt19937 rng(42);
+
+    for (size_t n: {0, 1, 2, 17, 1000, 100003}) {
+        for (size_t g: {0, 1, 7, 1000}) {
+            std::vector<int> a(n);
+            for (auto& x: a) x = (int)(rng() % 1000);
+            std::vector<int> expect(a);
+            std::sort(expect.begin(), expect.end());
+
+            clue::parallel_sort(P, a, g);
+            assert(a == expect);
+        }
+    }
+
+    // fast_vector, with a custom comparator
+    clue::fast_vector<long> v;
+    for (int i = 0; i < 5000; ++i) v.push_back((long)(rng() % 100000));
+    std::vector<long> expect(v.begin(), v.end());
+    std::sort(expect.begin(), expect.end(), std::greater<long>());
+    clue::parallel_sort(P, v, std::greater<long>(), 100);
+    assert(std::equal(v.begin(), v.end(), expect.begin()));
+
+    // strings (moved through the buffer), over an array_view
+    std::vector<std::string> ss;
+    for (int i = 0; i < 3000; ++i) ss.push_back(std::to_string(rng() % 10000));
+    std::vector<std::string> sexpect(ss);
+    std::sort(sexpect.begin(), sexpect.end());
+    clue::array_view<std::string> sv(ss.data(), ss.size());
+    clue::parallel_sort(P, sv);
+    assert(ss == sexpect);
+
+    P.wait_done();
+}
+
+int main() {
+    test_for_each_and_transform();
+    test_reduce();
+    test_scan();
+    test_sort();
+    return 0;
+}
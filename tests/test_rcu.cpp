@@ -0,0 +1,150 @@
+#include <clue/rcu.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cassert>
+#include <cstdio>
+
+// a record that detects accesses after deletion
+struct record {
+    static std::atomic<long> n_alive;
+
+    long magic;
+    long version;
+    std::vector<long> items;   // all equal to version
+
+    explicit record(long v = 0)
+        : magic(12345), version(v), items(16, v) {
+        n_alive ++;
+    }
+
+    record(const record& r)
+        : magic(12345), version(r.version), items(r.items) {
+        n_alive ++;
+    }
+
+    ~record() {
+        magic = 0;
+        n_alive --;
+    }
+
+    bool valid() const {
+        if (magic != 12345) return false;
+        for (long x: items) if (x != version) return false;
+        return true;
+    }
+};
+
+std::atomic<long> record::n_alive(0);
+
+record next_version(const record& r) {
+    return record(r.version + 1);
+}
+
+void test_basics() {
+    std::printf("testing basics ...\n");
+    {
+        clue::rcu_cell<record> c(record(1), 4);
+        assert(c.domain().num_slots() == 4);
+        assert(c.read()->version == 1);
+        assert(c.load().version == 1);
+
+        c.store(record(2));
+        assert(c.read()->version == 2);
+        c.update(next_version);
+        assert(c.read()->version == 3);
+        c.emplace(10L);
+        assert((*c.read()).version == 10);
+
+        // without readers, old versions are reclaimed by later updates
+        c.update(next_version);
+        c.update(next_version);
+        assert(c.num_retired() <= 2);
+        c.synchronize();
+        assert(c.num_retired() == 0);
+        assert(record::n_alive.load() == 1);
+
+        // a snapshot keeps its version alive
+        auto s = c.read();
+        assert(s && s->version == 12);
+        for (int i = 0; i < 5; ++i) c.update(next_version);
+        assert(s->valid() && s->version == 12);
+        assert(c.num_retired() >= 1);
+        assert(c.read()->version == 17);
+
+        // a snapshot can be moved and released on another thread
+        std::thread t([&s](){
+            clue::rcu_cell<record>::snapshot s2(std::move(s));
+            assert(s2->version == 12);
+            s2.release();
+            assert(!s2);
+        });
+        t.join();
+        assert(!s);
+        c.synchronize();
+        assert(c.num_retired() == 0);
+        assert(record::n_alive.load() == 1);
+    }
+    assert(record::n_alive.load() == 0);
+
+    // the domain on its own
+    clue::rcu_domain d(2);
+    uint64_t e0 = d.epoch();
+    {
+        auto g = d.read_lock();
+        assert(g.owns());
+        assert(d.poll(e0 + 1));     // the bank of the previous epoch is empty
+        assert(!d.poll(e0 + 2));    // g is in the bank of e0
+        assert(d.epoch() == e0 + 1);
+    }
+    d.synchronize();
+    assert(d.epoch() >= e0 + 3);
+}
+
+void test_concurrent(size_t nr, size_t nw) {
+    std::printf("testing concurrent reads and updates with %zu readers and %zu writers ...\n",
+        nr, nw);
+
+    const long N = 2000;   // # updates per writer
+    {
+        clue::rcu_cell<record> c(record(0), 4);
+        std::atomic<bool> stop(false);
+        std::atomic<bool> correct(true);
+
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < nr; ++t) {
+            readers.emplace_back([&](){
+                long last = 0;
+                while (!stop.load()) {
+                    auto s = c.read();
+                    if (!s->valid() || s->version < last) correct = false;
+                    last = s->version;
+                }
+            });
+        }
+
+        std::vector<std::thread> writers;
+        for (size_t t = 0; t < nw; ++t) {
+            writers.emplace_back([&](){
+                for (long i = 0; i < N; ++i) c.update(next_version);
+            });
+        }
+
+        for (auto& t: writers) t.join();
+        stop = true;
+        for (auto& t: readers) t.join();
+
+        assert(correct.load());
+        assert(c.read()->version == N * (long)nw);
+        c.synchronize();
+        assert(record::n_alive.load() == 1);
+    }
+    assert(record::n_alive.load() == 0);
+}
+
+int main() {
+    test_basics();
+    test_concurrent(4, 1);
+    test_concurrent(4, 2);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <clue/seqlock.hpp>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+// invariant: b == 2 * a && c == 3 * a
+struct triple {
+    long a, b, c;
+    char tag;
+};
+
+bool consistent(const triple& t) {
+    return t.b == 2 * t.a && t.c == 3 * t.a && t.tag == 'x';
+}
+
+void test_basics() {
+    std::printf("testing basics ...\n");
+
+    clue::seqlock<triple> sl(triple{1, 2, 3, 'x'});
+    assert(sl.sequence() == 0);
+    triple t = sl.load();
+    assert(consistent(t) && t.a == 1);
+
+    sl.store(triple{2, 4, 6, 'x'});
+    assert(sl.sequence() == 2);
+    assert(sl.load().c == 6);
+
+    sl.update([](triple& r){ r.a += 1; r.b += 2; r.c += 3; });
+    assert(sl.sequence() == 4);
+    assert(sl.try_load(t));
+    assert(consistent(t) && t.a == 3);
+
+    clue::seqlock<int> si;
+    assert(si.load() == 0);
+    si.store(42);
+    assert(si.load() == 42);
+}
+
+void test_concurrent(size_t nr, size_t nw) {
+    std::printf("testing concurrent reads and writes with %zu readers and %zu writers ...\n",
+        nr, nw);
+
+    const long N = 20000;   // # updates per writer
+    clue::seqlock<triple> sl(triple{0, 0, 0, 'x'});
+    std::atomic<bool> stop(false);
+    std::atomic<bool> correct(true);
+
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < nr; ++t) {
+        readers.emplace_back([&](){
+            long last = 0;
+            while (!stop.load()) {
+                triple r = sl.load();
+                if (!consistent(r) || r.a < last) correct = false;
+                last = r.a;
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (size_t t = 0; t < nw; ++t) {
+        writers.emplace_back([&](){
+            for (long i = 0; i < N; ++i) {
+                sl.update([](triple& r){ r.a += 1; r.b += 2; r.c += 3; });
+            }
+        });
+    }
+
+    for (auto& t: writers) t.join();
+    stop = true;
+    for (auto& t: readers) t.join();
+
+    assert(correct.load());
+    triple r = sl.load();
+    assert(consistent(r) && r.a == N * (long)nw);
+    assert(sl.sequence() == 2u * N * nw);
+}
+
+int main() {
+    test_basics();
+    test_concurrent(4, 1);
+    test_concurrent(4, 2);
+    return 0;
+}
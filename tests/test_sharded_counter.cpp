@@ -0,0 +1,57 @@
+#include <clue/sharded_counter.hpp>
+#include <thread>
+#include <vector>
+#include <cstdio>
+
+void test_basics() {
+    std::printf("testing basics ...\n");
+
+    clue::sharded_counter c0;
+    assert(c0.num_shards() >= 1);
+    assert(c0.get() == 0);
+
+    clue::sharded_counter c(5);
+    assert(c.num_shards() == 8);
+    c.inc();
+    c.inc(10);
+    c.dec(3);
+    assert(c.get() == 8);
+    assert(c.wait_for(8L, std::chrono::milliseconds(1)));
+    assert(!c.wait_for(clue::gt(8), std::chrono::milliseconds(10)));
+
+    c.reset();
+    assert(c.get() == 0);
+}
+
+void test_concurrent_updates(size_t nt) {
+    std::printf("testing concurrent updates with %zu threads ...\n", nt);
+
+    const long N = 100000;
+    clue::sharded_counter c(4);
+
+    long target = static_cast<long>(nt) * N;
+    std::thread listener([&](){
+        c.wait( clue::ge(target) );
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nt; ++t) {
+        workers.emplace_back([&c,N](){
+            for (long i = 0; i < N; ++i) {
+                c.inc(3);
+                c.dec(2);
+            }
+        });
+    }
+
+    for (auto& th: workers) th.join();
+    listener.join();
+    assert(c.get() == target);
+}
+
+int main() {
+    test_basics();
+    test_concurrent_updates(3);
+    test_concurrent_updates(8);
+    return 0;
+}
@@ -3,6 +3,8 @@
 
 #include <clue/shared_mutex.hpp>
 #include <thread>
+#include <atomic>
+#include <vector>
 #include <iostream>
 
 using namespace clue;
@@ -29,10 +31,11 @@ public:
     }
 };
 
-void test_exclusive_lock() {
-    std::printf("Testing exclusive locking ...\n");
+template<class Mutex>
+void test_exclusive_lock(const char *name) {
+    std::printf("Testing exclusive locking (%s) ...\n", name);
 
-    shared_mutex smut;
+    Mutex smut;
     bool correct = true;
 
     Gate t1_locked;
@@ -40,7 +43,7 @@ void test_exclusive_lock() {
 
     std::thread t1([&](){
         std::printf("  t1: enter\n");
-        unique_lock<shared_mutex> lk(smut);
+        unique_lock<Mutex> lk(smut);
         std::printf("  t1: locked\n");
         t1_locked.fire();
         std::printf("  t1: wait for exit\n");
@@ -83,10 +86,11 @@ void test_exclusive_lock() {
 }
 
 
-void test_shared_lock() {
-    std::printf("Testing shared locking ...\n");
+template<class Mutex>
+void test_shared_lock(const char *name) {
+    std::printf("Testing shared locking (%s) ...\n", name);
 
-    shared_mutex smut;
+    Mutex smut;
     bool correct = true;
 
     Gate t1_locked;
@@ -94,7 +98,7 @@ void test_shared_lock() {
 
     std::thread t1([&](){
         std::printf("  t1: enter\n");
-        unique_lock<shared_mutex> lk(smut);
+        unique_lock<Mutex> lk(smut);
         std::printf("  t1: locked\n");
         t1_locked.fire();
         std::printf("  t1: wait for exit\n");
@@ -126,7 +130,7 @@ void test_shared_lock() {
 
     std::thread t3([&](){
         std::printf("  t3: enter\n");
-        shared_lock<shared_mutex> lk(smut);
+        shared_lock<Mutex> lk(smut);
         std::printf("  t3: locked (shared)\n");
         t3_locked.fire();
         t4_locked.wait();
@@ -136,7 +140,7 @@ void test_shared_lock() {
 
     std::thread t4([&](){
         std::printf("  t4: enter\n");
-        shared_lock<shared_mutex> lk(smut);
+        shared_lock<Mutex> lk(smut);
         std::printf("  t4: locked (shared)\n");
         t4_locked.fire();
         t3_locked.wait();
@@ -161,8 +165,9 @@ void test_shared_lock() {
     assert(correct);
 }
 
+template<class Mutex>
 void test_shared_unlock() {
-    using mutex_t = shared_mutex;
+    using mutex_t = Mutex;
     mutex_t mut;
     shared_lock<mutex_t> lk1(mut);
     lk1.unlock();
@@ -172,10 +177,66 @@ void test_shared_unlock() {
     assert(lk2.try_lock());
 }
 
+// readers must never see a half-done update, and each
+// increment by the writers must be retained
+void test_distributed_stress() {
+    std::printf("Testing distributed_shared_mutex under contention ...\n");
+
+    distributed_shared_mutex smut(4);
+    long a = 0, b = 0;   // invariant: a == b
+    const long nw = 2000;
+    bool correct = true;
+    std::atomic<bool> stop(false);
+
+    std::vector<std::thread> readers;
+    for (int k = 0; k < 4; ++k) {
+        readers.emplace_back([&](){
+            while (!stop.load()) {
+                shared_lock<distributed_shared_mutex> lk(smut);
+                if (a != b) correct = false;
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int k = 0; k < 2; ++k) {
+        writers.emplace_back([&](){
+            for (long i = 0; i < nw; ++i) {
+                unique_lock<distributed_shared_mutex> lk(smut);
+                a ++;
+                b ++;
+            }
+        });
+    }
+
+    for (auto& t: writers) t.join();
+    stop = true;
+    for (auto& t: readers) t.join();
+    assert(correct);
+    assert(a == 2 * nw && b == 2 * nw);
+
+    // a shared lock released on another thread than the one locking it
+    shared_lock<distributed_shared_mutex> lk(smut);
+    std::thread t([&lk](){ lk.unlock(); });
+    t.join();
+    assert(smut.try_lock());
+    smut.unlock();
+}
+
 int main() {
-    test_exclusive_lock();
-    test_shared_lock();
-    test_shared_unlock();
+    test_exclusive_lock<shared_mutex>("shared_mutex");
+    test_shared_lock<shared_mutex>("shared_mutex");
+    test_shared_unlock<shared_mutex>();
+
+    using spinning_mutex = basic_shared_mutex<spin_then_park<>>;
+    test_exclusive_lock<spinning_mutex>("spin_then_park");
+    test_shared_lock<spinning_mutex>("spin_then_park");
+    test_shared_unlock<spinning_mutex>();
+
+    test_exclusive_lock<distributed_shared_mutex>("distributed_shared_mutex");
+    test_shared_lock<distributed_shared_mutex>("distributed_shared_mutex");
+    test_shared_unlock<distributed_shared_mutex>();
+    test_distributed_stress();
     return 0;
 }
 
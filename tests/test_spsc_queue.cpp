@@ -0,0 +1,232 @@
+#include <clue/spsc_queue.hpp>
+#include <thread>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <limits>
+#include <cstdio>
+
+void test_basics() {
+    std::printf("testing basics ...\n");
+
+    clue::spsc_queue<std::string> Q(3);
+    assert(Q.capacity() == 4);
+    assert(Q.empty());
+
+    assert(Q.try_push("a"));
+    assert(Q.try_push(2, 'b'));
+    Q.push("c");
+    assert(Q.try_push(std::string("d")));
+    assert(!Q.try_push("e"));
+    assert(Q.size() == 4);
+
+    std::string v;
+    assert(Q.try_pop(v));
+    assert(v == "a");
+    assert(Q.wait_pop() == "bb");
+    assert(Q.size() == 2);
+
+    // batch operations wrap around the end of the buffer
+    std::vector<std::string> src = {"x", "y", "z"};
+    assert(Q.push_n(src.begin(), 3) == 2);
+    assert(Q.size() == 4);
+
+    std::vector<std::string> dst(5);
+    assert(Q.pop_n(dst.begin(), 5) == 4);
+    assert(dst[0] == "c");
+    assert(dst[1] == "d");
+    assert(dst[2] == "x");
+    assert(dst[3] == "y");
+    assert(Q.empty());
+    assert(!Q.try_pop(v));
+    assert(Q.pop_n(dst.begin(), 5) == 0);
+
+    Q.push("p");
+    Q.push("q");
+    Q.clear();
+    assert(Q.empty());
+
+    // a capacity that cannot be rounded up is rejected
+    bool caught = false;
+    try {
+        clue::spsc_queue<int> Q2(std::numeric_limits<size_t>::max());
+    } catch (const std::length_error&) {
+        caught = true;
+    }
+    assert(caught);
+}
+
+// an element that counts the live instances,
+// whose copy throws when v == bad_copy, and whose
+// assignment throws when the source has v == bad_assign
+struct fragile {
+    static constexpr int bad_copy = -1;
+    static constexpr int bad_assign = -2;
+    static int live;
+    int v;
+
+    explicit fragile(int x) : v(x) { ++live; }
+    fragile(const fragile& r) : v(r.v) {
+        if (v == bad_copy) throw std::runtime_error("fragile: bad copy");
+        ++live;
+    }
+    fragile& operator=(const fragile& r) {
+        if (r.v == bad_assign) throw std::runtime_error("fragile: bad assign");
+        v = r.v;
+        return *this;
+    }
+    ~fragile() { --live; }
+};
+
+int fragile::live = 0;
+
+void test_push_n_exceptions() {
+    std::printf("testing push_n with a throwing copy ...\n");
+    {
+        clue::spsc_queue<fragile> Q(8);
+        std::vector<fragile> src;
+        for (int x: {1, 2, fragile::bad_copy, 4}) src.emplace_back(x);
+        int live0 = fragile::live;
+
+        // the elements constructed before the failure are destroyed,
+        // and nothing of the batch is pushed
+        bool caught = false;
+        try {
+            Q.push_n(src.begin(), 4);
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        assert(caught);
+        assert(fragile::live == live0);
+        assert(Q.empty());
+
+        // the queue remains usable
+        assert(Q.push_n(src.begin(), 2) == 2);
+        assert(Q.size() == 2);
+        assert(Q.wait_pop().v == 1);
+        assert(Q.wait_pop().v == 2);
+        assert(Q.empty());
+    }
+    assert(fragile::live == 0);
+}
+
+void test_pop_n_exceptions() {
+    std::printf("testing pop_n with a throwing move ...\n");
+    {
+        clue::spsc_queue<fragile> Q(8);
+        for (int x: {1, 2, fragile::bad_assign, 4}) assert(Q.try_push(x));
+        std::vector<fragile> dst;
+        for (int i = 0; i < 4; ++i) dst.emplace_back(0);
+        int live0 = fragile::live;
+
+        // the elements before the failure and the failed one are popped
+        bool caught = false;
+        try {
+            Q.pop_n(dst.begin(), 4);
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        assert(caught);
+        assert(dst[0].v == 1 && dst[1].v == 2);
+        assert(fragile::live == live0 - 3);
+        assert(Q.size() == 1);
+
+        // the queue remains usable, and nothing is destroyed twice
+        assert(Q.pop_n(dst.begin(), 4) == 1);
+        assert(dst[0].v == 4);
+        assert(Q.empty());
+        Q.clear();
+        assert(fragile::live == live0 - 4);
+    }
+    assert(fragile::live == 0);
+}
+
+void test_concurrent(size_t cap) {
+    std::printf("testing concurrent producer/consumer (cap = %zu) ...\n", cap);
+
+    clue::spsc_queue<long> Q(cap);
+    const long N = 100000;
+
+    std::thread producer([&Q,N](){
+        for (long i = 0; i < N; ++i) Q.push(i + 1);
+    });
+
+    long total = 0;
+    long last = 0;
+    bool in_order = true;
+    std::thread consumer([&](){
+        for (long i = 0; i < N; ++i) {
+            long v = Q.wait_pop();
+            if (v != last + 1) in_order = false;
+            last = v;
+            total += v;
+        }
+    });
+
+    producer.join();
+    consumer.join();
+
+    assert(in_order);
+    assert(total == N * (N + 1) / 2);
+    assert(Q.empty());
+}
+
+void test_concurrent_batch(size_t cap) {
+    std::printf("testing concurrent batch push_n/pop_n (cap = %zu) ...\n", cap);
+
+    clue::spsc_queue<long> Q(cap);
+    const long N = 100000;
+    const size_t B = 7;
+
+    std::thread producer([&Q,N,B](){
+        long buf[B];
+        long i = 0;
+        while (i < N) {
+            size_t m = 0;
+            for (; m < B && i + (long)m < N; ++m) buf[m] = i + (long)m + 1;
+            size_t k = 0;
+            while (k < m) {
+                size_t r = Q.push_n(buf + k, m - k);
+                if (r == 0) std::this_thread::yield();
+                k += r;
+            }
+            i += (long)m;
+        }
+    });
+
+    long total = 0;
+    long last = 0;
+    bool in_order = true;
+    std::thread consumer([&](){
+        long buf[B];
+        long n = 0;
+        while (n < N) {
+            size_t r = Q.pop_n(buf, B);
+            if (r == 0) std::this_thread::yield();
+            for (size_t k = 0; k < r; ++k) {
+                if (buf[k] != last + 1) in_order = false;
+                last = buf[k];
+                total += buf[k];
+            }
+            n += (long)r;
+        }
+    });
+
+    producer.join();
+    consumer.join();
+
+    assert(in_order);
+    assert(total == N * (N + 1) / 2);
+    assert(Q.empty());
+}
+
+int main() {
+    test_basics();
+    test_push_n_exceptions();
+    test_pop_n_exceptions();
+    test_concurrent(2);
+    test_concurrent(1024);
+    test_concurrent_batch(16);
+    test_concurrent_batch(1024);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <clue/task_function.hpp>
+#include <memory>
+#include <string>
+#include <future>
+
+using clue::task_function;
+
+struct Counted {
+    static int count;
+    int v;
+
+    explicit Counted(int v_) : v(v_) { count++; }
+    Counted(const Counted& r) : v(r.v) { count++; }
+    Counted(Counted&& r) noexcept : v(r.v) { count++; }
+    ~Counted() { count--; }
+
+    int operator()(int x) const { return v + x; }
+};
+
+int Counted::count = 0;
+
+TEST(TaskFunction, Empty) {
+    task_function<void()> f0;
+    ASSERT_FALSE(bool(f0));
+    ASSERT_FALSE(f0.is_inline());
+
+    task_function<void()> f1(nullptr);
+    ASSERT_FALSE(bool(f1));
+}
+
+TEST(TaskFunction, SmallCallable) {
+    int a = 1, b = 2;
+    task_function<int(int)> f([a, b](int x){ return a + b + x; });
+    ASSERT_TRUE(bool(f));
+    ASSERT_TRUE(f.is_inline());
+    ASSERT_EQ(13, f(10));
+
+    task_function<int(int)> f2(std::move(f));
+    ASSERT_FALSE(bool(f));
+    ASSERT_TRUE(f2.is_inline());
+    ASSERT_EQ(23, f2(20));
+}
+
+TEST(TaskFunction, LargeCallable) {
+    char buf[100] = {0};
+    buf[99] = 5;
+    task_function<int(int)> f([buf](int x){ return buf[99] + x; });
+    ASSERT_TRUE(bool(f));
+    ASSERT_FALSE(f.is_inline());
+    ASSERT_EQ(15, f(10));
+
+    task_function<int(int)> f2;
+    f2 = std::move(f);
+    ASSERT_FALSE(bool(f));
+    ASSERT_FALSE(f2.is_inline());
+    ASSERT_EQ(25, f2(20));
+
+    // a larger inline capacity
+    task_function<int(int), 128> g([buf](int x){ return buf[99] + x; });
+    ASSERT_TRUE(g.is_inline());
+    ASSERT_EQ(7, g(2));
+}
+
+template<class T>
+struct CountingAlloc {
+    typedef T value_type;
+    static int live;
+
+    CountingAlloc() = default;
+    template<class U>
+    CountingAlloc(const CountingAlloc<U>&) {}
+
+    T* allocate(size_t n) {
+        CountingAlloc<char>::live++;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        CountingAlloc<char>::live--;
+        std::allocator<T>().deallocate(p, n);
+    }
+};
+
+template<class T>
+int CountingAlloc<T>::live = 0;
+
+TEST(TaskFunction, CustomAllocator) {
+    using fn_t = task_function<int(int), 64, CountingAlloc<char>>;
+    char buf[100] = {0};
+    buf[99] = 5;
+    {
+        fn_t f([buf](int x){ return buf[99] + x; });
+        ASSERT_FALSE(f.is_inline());
+        ASSERT_EQ(1, CountingAlloc<char>::live);
+
+        fn_t f2(std::move(f));
+        ASSERT_EQ(1, CountingAlloc<char>::live);
+        ASSERT_EQ(15, f2(10));
+
+        // small callables do not use the allocator
+        fn_t g([](int x){ return x + 1; });
+        ASSERT_TRUE(g.is_inline());
+        ASSERT_EQ(1, CountingAlloc<char>::live);
+    }
+    ASSERT_EQ(0, CountingAlloc<char>::live);
+}
+
+TEST(TaskFunction, Lifetime) {
+    ASSERT_EQ(0, Counted::count);
+    {
+        task_function<int(int)> f(Counted(3));
+        ASSERT_EQ(1, Counted::count);
+        ASSERT_EQ(5, f(2));
+
+        task_function<int(int)> g(std::move(f));
+        ASSERT_EQ(1, Counted::count);
+        ASSERT_EQ(6, g(3));
+
+        g = nullptr;
+        ASSERT_FALSE(bool(g));
+        ASSERT_EQ(0, Counted::count);
+
+        f = task_function<int(int)>(Counted(4));
+        ASSERT_EQ(1, Counted::count);
+    }
+    ASSERT_EQ(0, Counted::count);
+}
+
+struct StrLen {
+    std::unique_ptr<std::string> p;
+    size_t operator()() const { return p->size(); }
+};
+
+TEST(TaskFunction, MoveOnlyCallable) {
+    StrLen sl;
+    sl.p.reset(new std::string("abcd"));
+    task_function<size_t()> f(std::move(sl));
+    ASSERT_TRUE(f.is_inline());
+    ASSERT_EQ(4, f());
+
+    std::packaged_task<int(int)> pt([](int x){ return x * 2; });
+    std::future<int> fut = pt.get_future();
+    task_function<void(int)> g(std::move(pt));
+    g(21);
+    ASSERT_EQ(42, fut.get());
+}
@@ -0,0 +1,214 @@
+#include <clue/task_graph.hpp>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+using clue::task_handle;
+using clue::launch;
+
+void sleep_ms(size_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void test_launch_and_then() {
+    std::printf("testing launch and then ...\n");
+    clue::thread_pool P(2);
+
+    task_handle<int> h = launch(P, [](size_t){ sleep_ms(5); return 21; });
+    assert(h.valid());
+    auto h2 = h.then(P, [](size_t, int x){ return x * 2; })
+               .then(P, [](size_t, int x){ return std::to_string(x); });
+    assert(h2.get() == "42");
+    assert(h.ready());
+    assert(h.get() == 21);
+
+    // continuation of a ready handle
+    auto h3 = h.then(P, [](size_t, int x){ return x + 1; });
+    assert(h3.get() == 22);
+
+    // void tasks
+    std::atomic<int> c(0);
+    auto v = launch(P, [&c](size_t){ c += 1; })
+                .then(P, [&c](size_t){ c += 10; });
+    v.get();
+    assert(c.load() == 11);
+
+    // exceptions skip the continuations and are forwarded
+    std::atomic<bool> called(false);
+    auto e = launch(P, [](size_t) -> int { throw std::runtime_error("bad"); })
+                .then(P, [&called](size_t, int x){ called = true; return x; });
+    bool caught = false;
+    try { e.get(); } catch (const std::runtime_error&) { caught = true; }
+    assert(caught);
+    assert(!called.load());
+
+    P.wait_done();
+}
+
+void test_no_blocking_on_small_pool() {
+    std::printf("testing continuation chains on a single thread ...\n");
+    clue::thread_pool P(1);
+
+    // a long chain on a single worker: nothing blocks the worker
+    task_handle<long> h = launch(P, [](size_t){ return 0L; });
+    for (long i = 1; i <= 1000; ++i) {
+        h = h.then(P, [i](size_t, long x){ return x + i; });
+    }
+    assert(h.get() == 500500L);
+
+    // continuations scheduled while the pool is synchronizing
+    auto g = launch(P, [](size_t){ sleep_ms(10); return 1; })
+                .then(P, [](size_t, int x){ return x + 1; });
+    P.synchronize();
+    assert(g.ready());
+    assert(g.get() == 2);
+    P.wait_done();
+}
+
+void test_when_all_any() {
+    std::printf("testing when_all and when_any ...\n");
+    clue::thread_pool P(4);
+
+    std::vector<task_handle<int>> hs;
+    for (int i = 0; i < 8; ++i) {
+        hs.push_back(launch(P, [i](size_t){ sleep_ms(8 - i); return i * i; }));
+    }
+    auto all = clue::when_all(hs).then(P, [](size_t, const std::vector<int>& v){
+        int s = 0;
+        for (int x: v) s += x;
+        return s;
+    });
+    assert(all.get() == 140);
+    assert(clue::when_all(hs).get() == std::vector<int>({0, 1, 4, 9, 16, 25, 36, 49}));
+
+    // empty
+    assert(clue::when_all(std::vector<task_handle<int>>()).get().empty());
+    clue::when_all(std::vector<task_handle<void>>()).get();
+
+    // void
+    std::atomic<int> c(0);
+    std::vector<task_handle<void>> vs;
+    for (int i = 0; i < 5; ++i) {
+        vs.push_back(launch(P, [&c](size_t){ c ++; }));
+    }
+    clue::when_all(vs).get();
+    assert(c.load() == 5);
+
+    // failure
+    std::vector<task_handle<int>> fs;
+    fs.push_back(launch(P, [](size_t){ return 1; }));
+    fs.push_back(launch(P, [](size_t) -> int { throw std::logic_error("x"); }));
+    bool caught = false;
+    try { clue::when_all(fs).get(); } catch (const std::logic_error&) { caught = true; }
+    assert(caught);
+
+    // when_any
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    std::vector<task_handle<int>> as;
+    as.push_back(launch(P, [gf](size_t){ gf.wait(); return 0; }));
+    as.push_back(launch(P, [](size_t){ return 1; }));
+    assert(clue::when_any(as).get() == 1);
+    gate.set_value();
+    as[0].wait();
+    assert(clue::when_any(as).get() == 0);
+
+    P.wait_done();
+}
+
+void test_task_graph() {
+    std::printf("testing task_graph ...\n");
+    clue::thread_pool P(2);
+
+    // a diamond per layer:  a -> (b, c) -> d -> ...
+    clue::task_graph G;
+    std::mutex mut;
+    std::vector<std::string> log;
+    auto rec = [&](const char *s) {
+        return [&mut, &log, s](size_t){
+            sleep_ms(1);
+            std::lock_guard<std::mutex> lk(mut);
+            log.push_back(s);
+        };
+    };
+    auto a = G.add(rec("a"));
+    auto b = G.add(rec("b"), {a});
+    auto c = G.add(rec("c"), {a});
+    auto d = G.add(rec("d"), {b, c});
+    auto e = G.add(rec("e"));
+    G.precede(e, d);
+    assert(G.size() == 5);
+
+    for (int t = 0; t < 3; ++t) {
+        log.clear();
+        G.run(P).get();
+        assert(log.size() == 5);
+        auto pos = [&](const char *s) {
+            return std::find(log.begin(), log.end(), std::string(s)) - log.begin();
+        };
+        assert(pos("a") < pos("b"));
+        assert(pos("a") < pos("c"));
+        assert(pos("b") < pos("d"));
+        assert(pos("c") < pos("d"));
+        assert(pos("e") < pos("d"));
+    }
+
+    // a wide and deep graph on a single worker
+    clue::thread_pool P1(1);
+    clue::task_graph H;
+    std::atomic<long> s(0);
+    std::vector<clue::task_graph::node_id> prev;
+    for (long l = 0; l < 20; ++l) {
+        std::vector<clue::task_graph::node_id> cur;
+        for (long k = 0; k < 10; ++k) {
+            auto v = H.add([&s, l](size_t){ s += l; });
+            for (auto u: prev) H.precede(u, v);
+            cur.push_back(v);
+        }
+        prev.swap(cur);
+    }
+    H.run(P1).then(P1, [&s](size_t){ s += 1000; }).get();
+    assert(s.load() == 10 * 190 + 1000);
+    P1.wait_done();
+
+    // exceptions
+    clue::task_graph X;
+    std::atomic<int> nrun(0);
+    auto x0 = X.add([](size_t){ throw std::runtime_error("x0"); });
+    X.add([&nrun](size_t){ nrun ++; }, {x0});
+    bool caught = false;
+    try { X.run(P).get(); } catch (const std::runtime_error&) { caught = true; }
+    assert(caught);
+    assert(nrun.load() == 0);
+
+    // cycles
+    clue::task_graph Y;
+    auto y0 = Y.add([](size_t){});
+    auto y1 = Y.add([](size_t){}, {y0});
+    Y.precede(y1, y0);
+    caught = false;
+    try { Y.run(P); } catch (const std::invalid_argument&) { caught = true; }
+    assert(caught);
+
+    // empty graph
+    clue::task_graph Z;
+    assert(Z.run(P).ready());
+
+    // run on a closed pool
+    clue::thread_pool Q(1);
+    Q.wait_done();
+    caught = false;
+    try { X.run(Q).get(); } catch (const std::runtime_error&) { caught = true; }
+    assert(caught);
+    assert(nrun.load() == 0);
+
+    P.wait_done();
+}
+
+int main() {
+    test_launch_and_then();
+    test_no_blocking_on_small_pool();
+    test_when_all_any();
+    test_task_graph();
+    return 0;
+}
@@ -1,4 +1,9 @@
 #include <clue/thread_pool.hpp>
+#include <clue/value_range.hpp>
+#include <clue/array_view.hpp>
+#include <atomic>
+#include <array>
+#include <algorithm>
 #include <cstdio>
 
 void test_construction_and_resize() {
@@ -54,6 +59,29 @@ void test_schedule_and_wait() {
     assert(P.empty());
 }
 
+void test_post() {
+    std::printf("TEST thread_pool: post\n");
+    clue::thread_pool P(4);
+
+    std::atomic<long> s(0);
+    for (long i = 1; i <= 1000; ++i) {
+        P.post([&s, i](size_t){ s += i; });
+    }
+    P.synchronize();
+    assert(s.load() == 500500);
+    assert(1000 == P.num_completed_tasks());
+
+    // large captures are stored on the heap
+    std::array<long, 32> a;
+    a.fill(2);
+    for (size_t i = 0; i < 100; ++i) {
+        P.post([&s, a](size_t){ s += a[31]; });
+    }
+    P.wait_done();
+    assert(s.load() == 500700);
+    assert(1100 == P.num_completed_tasks());
+}
+
 void test_synchronize() {
     std::printf("TEST thread_pool: synchronize\n");
     clue::thread_pool P(4);
@@ -123,10 +151,550 @@ void test_early_stop_and_revive() {
 }
 
 
+void test_schedule_bulk() {
+    std::printf("TEST thread_pool: schedule_bulk\n");
+    clue::thread_pool P(4);
+
+    const size_t n = 10000;
+    std::vector<int> hits(n, 0);
+    std::atomic<long> sum(0);
+
+    auto h = P.schedule_bulk(size_t(0), n, [&](size_t tid, size_t i){
+        assert(tid < 4);
+        hits[i] += 1;
+        sum += static_cast<long>(i);
+    }, 100);
+    assert(h.valid());
+    assert(h.size() == n);
+    assert(h.chunk_size() == 100);
+    h.wait();
+    assert(h.done());
+
+    for (size_t i = 0; i < n; ++i) assert(hits[i] == 1);
+    assert(sum == static_cast<long>(n * (n - 1) / 2));
+
+    // at most one runner task per thread
+    P.synchronize();
+    assert(P.num_scheduled_tasks() <= 4);
+    assert(P.num_completed_tasks() == P.num_scheduled_tasks());
+
+    // signed indices & automatic chunk size
+    std::atomic<long> s2(0);
+    auto h2 = P.schedule_bulk(-50, 50, [&](size_t, int i){ s2 += i; });
+    auto h3 = P.schedule_bulk(5, 5, [&](size_t, int i){ s2 += 1000; });
+    h2.wait();
+    h3.wait();
+    assert(h3.done());
+    assert(s2 == -50);
+
+    // exceptions are propagated to wait()
+    auto h4 = P.schedule_bulk(0, 100, [](size_t, int i){
+        if (i == 37) throw std::runtime_error("bad index");
+    }, 10);
+    bool caught = false;
+    try {
+        h4.wait();
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+    assert(h4.done());
+
+    P.wait_done();
+}
+
+void test_parallel_for() {
+    std::printf("TEST thread_pool: parallel_for\n");
+    clue::thread_pool P(3);
+
+    // over a value range
+    std::atomic<long> sum(0);
+    P.parallel_for(clue::vrange(1, 1001), 16, [&](size_t, int x){
+        sum += x;
+    });
+    assert(sum == 500500);
+
+    // over a mutable container
+    std::vector<double> v(1000, 1.0);
+    P.parallel_for(v, [](size_t, double& x){ x *= 2.0; });
+    for (double x: v) assert(x == 2.0);
+
+    // over an array view
+    clue::array_view<double> av(v.data(), 500);
+    P.parallel_for(av, 7, [](size_t, double& x){ x = 0.0; });
+    for (size_t i = 0; i < v.size(); ++i) assert(v[i] == (i < 500 ? 0.0 : 2.0));
+
+    P.wait_done();
+}
+
+void test_placement() {
+    std::printf("TEST thread_pool: placement\n");
+
+    // pinned to a CPU set
+    std::vector<int> cpus0 = clue::this_thread_affinity();
+    if (!cpus0.empty()) {
+        std::vector<int> cpus(1, cpus0[0]);
+        clue::thread_pool P(2, clue::thread_placement::on_cpus(cpus));
+        assert(P.placement().groups.size() == 1);
+        for (size_t i = 0; i < 4; ++i) {
+            auto r = P.schedule([](size_t){ return clue::this_thread_affinity(); }).get();
+            assert(r == cpus);
+        }
+        P.wait_done();
+    }
+
+    // per NUMA node
+    clue::thread_placement pl = clue::thread_placement::per_numa_node();
+    assert(pl.groups.size() == clue::numa_nodes().size());
+    for (auto& g: pl.groups) {
+        assert(g.node >= 0);
+        assert(!g.cpus.empty());
+    }
+
+    // tasks with node hints
+    clue::thread_pool P(3, pl);
+    std::atomic<long> s(0);
+    for (long i = 1; i <= 100; ++i) {
+        int node = pl.groups.empty() ? 0 : pl.groups[i % pl.groups.size()].node;
+        P.post_on(node, [&s, i](size_t){ s += i; });
+    }
+    // hints for nonexistent nodes are ignored
+    P.post_on(12345, [&s](size_t){ s += 1000; });
+    assert(P.schedule_on(-1, [](size_t){ return 7; }).get() == 7);
+    P.wait_done();
+    assert(s.load() == 6050);
+    assert(P.num_completed_tasks() == 102);
+}
+
+void test_priorities() {
+    std::printf("TEST thread_pool: priorities and deadlines\n");
+    using clue::task_priority;
+
+    clue::thread_pool P(1);
+    P.set_starvation_limit(0);
+    assert(P.starvation_limit() == 0);
+
+    // hold the only worker until all tasks are queued
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    std::promise<void> started;
+    P.post([gf, &started](size_t){ started.set_value(); gf.wait(); });
+    started.get_future().wait();
+
+    std::vector<int> order;
+    auto rec = [&order](int v) {
+        return [&order, v](size_t){ order.push_back(v); };
+    };
+    auto t0 = std::chrono::steady_clock::now();
+    P.post(task_priority::low, rec(30));
+    P.post(rec(20));
+    P.post(task_priority::high, rec(10));
+    P.post(task_priority::low, rec(31));
+    P.post(task_priority::high, rec(11));
+    auto f = P.schedule(task_priority::high, [](size_t){ return 12; });
+    P.schedule_before(t0 + std::chrono::seconds(2), rec(2));
+    P.schedule_before(t0 + std::chrono::seconds(1), rec(1));
+    P.schedule_before(t0 + std::chrono::seconds(1), rec(0));  // ties are FIFO
+    gate.set_value();
+    P.wait_done();
+
+    assert(f.get() == 12);
+    std::vector<int> expect = {1, 0, 2, 10, 11, 20, 30, 31};
+    assert(order == expect);
+}
+
+void test_starvation_guard() {
+    std::printf("TEST thread_pool: starvation guard\n");
+    using clue::task_priority;
+
+    clue::thread_pool P(1);
+    P.set_starvation_limit(3);
+
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    std::promise<void> started;
+    P.post([gf, &started](size_t){ started.set_value(); gf.wait(); });
+    started.get_future().wait();
+
+    std::vector<int> order;
+    auto rec = [&order](int v) {
+        return [&order, v](size_t){ order.push_back(v); };
+    };
+    P.post(task_priority::low, rec(2));
+    for (int i = 0; i < 8; ++i) P.post(task_priority::high, rec(1));
+    gate.set_value();
+    P.wait_done();
+
+    // the low-priority task runs after being passed over 3 times
+    std::vector<int> expect = {1, 1, 1, 2, 1, 1, 1, 1, 1};
+    assert(order == expect);
+}
+
+// poll pred until it holds, or until a (generous) timeout expires
+template<class Pred>
+bool eventually(Pred&& pred) {
+    auto t = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > t) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void test_elastic() {
+    std::printf("TEST thread_pool: elastic\n");
+    using event_t = clue::thread_pool::resize_event;
+
+    std::mutex mut;
+    std::vector<event_t> events;
+    auto count_events = [&](event_t::reason_t r) {
+        std::lock_guard<std::mutex> lk(mut);
+        size_t c = 0;
+        for (auto& ev: events) if (ev.reason == r) c++;
+        return c;
+    };
+
+    clue::thread_pool::elastic_options opts;
+    opts.min_threads = 1;
+    opts.max_threads = 4;
+    opts.queue_threshold = 1;
+    opts.idle_timeout = std::chrono::milliseconds(50);
+    opts.on_resize = [&](const event_t& ev) {
+        std::lock_guard<std::mutex> lk(mut);
+        events.push_back(ev);
+    };
+
+    clue::thread_pool P(opts);
+    assert(P.elastic());
+    assert(P.size() == 1);
+
+    // grow under load: the tasks are held by a gate, so that tasks
+    // keep piling up while all workers are busy
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    std::atomic<long> s(0);
+    std::atomic<size_t> max_tidx(0);
+    auto record_tidx = [&](size_t tidx) {
+        size_t m = max_tidx.load();
+        while (tidx > m && !max_tidx.compare_exchange_weak(m, tidx));
+    };
+    for (long i = 1; i <= 40; ++i) {
+        P.post([&, gf, i](size_t tidx){
+            gf.wait();
+            record_tidx(tidx);
+            s += i;
+        });
+    }
+    assert(eventually([&](){ return P.size() == 4; }));
+    gate.set_value();
+    P.synchronize();
+    assert(s.load() == 820);
+    assert(P.size() <= 4);
+    assert(max_tidx.load() < 4);
+    {
+        // The spawns may be reported by different threads, hence in any
+        // order, but all are reported before their tasks complete.
+        std::lock_guard<std::mutex> lk(mut);
+        std::vector<size_t> ns;
+        for (auto& ev: events) {
+            if (ev.reason != event_t::idle_timeout) ns.push_back(ev.nthreads);
+        }
+        std::sort(ns.begin(), ns.end());
+        assert(ns == std::vector<size_t>({2, 3, 4}));
+    }
+
+    // shrink when idle
+    assert(eventually([&](){
+        return P.size() == 1 && count_events(event_t::idle_timeout) == 3;
+    }));
+    {
+        std::lock_guard<std::mutex> lk(mut);
+        events.clear();
+    }
+
+    // grow again (reusing retired slots)
+    std::promise<void> gate2;
+    std::shared_future<void> gf2 = gate2.get_future().share();
+    for (long i = 1; i <= 40; ++i) {
+        P.post([&, gf2, i](size_t tidx){
+            gf2.wait();
+            record_tidx(tidx);
+            s += i;
+        });
+    }
+    assert(eventually([&](){ return P.size() == 4; }));
+    gate2.set_value();
+    P.wait_done();
+    assert(s.load() == 1640);
+    assert(max_tidx.load() < 4);
+    assert(P.num_completed_tasks() == 80);
+
+    bool caught = false;
+    try {
+        clue::thread_pool Q(opts);
+        try {
+            Q.resize(3);
+        } catch (const std::runtime_error&) {
+            caught = true;
+        }
+        Q.wait_done();
+    } catch (...) {}
+    assert(caught);
+}
+
+void test_elastic_from_zero() {
+    std::printf("TEST thread_pool: elastic (from zero workers)\n");
+
+    clue::thread_pool::elastic_options opts;
+    opts.min_threads = 0;
+    opts.max_threads = 2;
+    opts.idle_timeout = std::chrono::milliseconds(20);
+
+    clue::thread_pool P(opts);
+    assert(P.size() == 0);
+
+    // a deadline task spawns a worker
+    auto f = P.schedule_before(
+        std::chrono::steady_clock::now() + std::chrono::seconds(1),
+        [](size_t){ return 7; });
+    assert(P.size() >= 1);
+    assert(f.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    assert(f.get() == 7);
+
+    // so does a bulk task, once the pool has shrunk back to zero
+    assert(eventually([&](){ return P.size() == 0; }));
+    std::atomic<long> s(0);
+    auto h = P.schedule_bulk(0L, 100L, [&](size_t, long i){ s += i; });
+    assert(P.size() >= 1);
+    assert(eventually([&](){ return h.done(); }));
+    assert(s.load() == 4950);
+
+    P.wait_done();
+    assert(P.num_completed_tasks() >= 2);
+}
+
+void test_elastic_bulk() {
+    std::printf("TEST thread_pool: elastic (bulk)\n");
+    using event_t = clue::thread_pool::resize_event;
+
+    std::atomic<size_t> n_grown(0);
+    clue::thread_pool::elastic_options opts;
+    opts.min_threads = 1;
+    opts.max_threads = 4;
+    opts.on_resize = [&](const event_t& ev) {
+        if (ev.reason == event_t::queue_depth) n_grown ++;
+    };
+
+    clue::thread_pool P(opts);
+    assert(P.size() == 1);
+    assert(P.concurrency() == 4);
+
+    // the bulk is spread over max_threads runners, rather than
+    // one per live worker, so that the pool grows for it
+    std::atomic<long> s(0);
+    auto h = P.schedule_bulk(0L, 400L, [&](size_t, long i){
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        s += i;
+    });
+    assert(h.chunk_size() == 25);
+    h.wait();
+    assert(s.load() == 79800);
+    assert(n_grown.load() >= 1);
+    assert(P.size() > 1);
+
+    P.wait_done();
+}
+
+void test_elastic_latency() {
+    std::printf("TEST thread_pool: elastic (wait latency)\n");
+    using event_t = clue::thread_pool::resize_event;
+
+    std::atomic<size_t> n_latency(0);
+    clue::thread_pool::elastic_options opts;
+    opts.min_threads = 0;
+    opts.max_threads = 2;
+    opts.queue_threshold = 100;
+    opts.wait_threshold = std::chrono::microseconds(1000);
+    opts.on_resize = [&](const event_t& ev) {
+        if (ev.reason == event_t::wait_latency) n_latency ++;
+    };
+
+    // a pool without workers spawns one for the first task
+    clue::thread_pool P(opts);
+    assert(P.size() == 0);
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    auto f0 = P.schedule([gf](size_t){ gf.wait(); return 1; });
+    assert(P.size() == 1);
+
+    // a task waits behind the blocked one, and the next
+    // submission finds that it has waited too long
+    auto f1 = P.schedule([](size_t){ return 2; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto f2 = P.schedule([](size_t){ return 3; });
+    assert(f1.get() + f2.get() == 5);
+    assert(P.size() == 2);
+    assert(n_latency.load() == 1);
+
+    gate.set_value();
+    assert(f0.get() == 1);
+    P.wait_done();
+}
+
+void test_nested_after_close() {
+    std::printf("TEST thread_pool: nested posts after close\n");
+    clue::thread_pool P(4);
+
+    // a running task posts children after the pool is closed: the
+    // idle workers stay until it finishes, and run the children
+    std::atomic<int> running(0);
+    std::atomic<int> max_running(0);
+    std::atomic<int> n_done(0);
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    P.post([&, gf](size_t){
+        gf.wait();
+        for (int i = 0; i < 4; ++i) {
+            P.post([&](size_t){
+                int r = ++running;
+                int m = max_running.load();
+                while (r > m && !max_running.compare_exchange_weak(m, r)) {}
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                running --;
+                n_done ++;
+            });
+        }
+    });
+
+    // the sleep gives the idle workers the time to (wrongly) exit
+    P.close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.set_value();
+    P.join();
+    assert(P.done());
+    assert(n_done.load() == 4);
+    assert(max_running.load() >= 2);
+    assert(P.num_completed_tasks() == 5);
+}
+
+void test_task_groups() {
+    std::printf("TEST thread_pool: task groups\n");
+    clue::thread_pool P(4);
+
+    // a long-running task outside of the groups
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    P.post([gf](size_t){ gf.wait(); });
+
+    std::atomic<long> s1(0), s2(0);
+    {
+        clue::task_group g1(P);
+        clue::task_group g2(P);
+        std::thread t2([&](){
+            for (long i = 1; i <= 100; ++i) {
+                g2.post([&s2, i](size_t){ s2 += i; });
+            }
+            g2.wait();
+            assert(s2.load() == 5050);
+        });
+        for (long i = 1; i <= 100; ++i) {
+            g1.post(clue::task_priority::high, [&s1, i](size_t){ s1 += i; });
+        }
+        // does not wait for the blocked task
+        g1.wait();
+        assert(s1.load() == 5050);
+        assert(g1.size() == 0);
+        t2.join();
+
+        // exceptions
+        g1.post([](size_t){ throw std::runtime_error("g1"); });
+        g1.post([&s1](size_t){ s1 += 1; });
+        bool caught = false;
+        try { g1.wait(); } catch (const std::runtime_error&) { caught = true; }
+        assert(caught);
+        assert(s1.load() == 5051);
+        g1.wait();  // the exception has been cleared
+    }
+    assert(!P.done());
+    gate.set_value();
+    P.wait_done();
+    assert(P.num_completed_tasks() == 203);
+}
+
+// Run under ThreadSanitizer (configure with -DCLUE_TSAN=ON) to check
+// that concurrent scheduling, synchronization and closing are race-free
+void test_concurrent_stress() {
+    std::printf("TEST thread_pool: concurrent schedule/synchronize/close\n");
+    const size_t ns = 4;   // # scheduling threads
+    clue::thread_pool P(4);
+
+    std::atomic<size_t> n_accepted(0);
+    std::atomic<size_t> n_run(0);
+    std::atomic<bool> closing(false);
+
+    std::vector<std::thread> schedulers;
+    for (size_t k = 0; k < ns; ++k) {
+        schedulers.emplace_back([&, k](){
+            for (size_t i = 0; ; ++i) {
+                try {
+                    if (i % 2 == 0) {
+                        P.post([&n_run](size_t){ n_run ++; });
+                    } else {
+                        P.schedule([&n_run](size_t){ n_run ++; });
+                    }
+                    n_accepted ++;
+                } catch (const std::runtime_error&) {
+                    // rejected while synchronizing or closed
+                    if (P.closed()) return;
+                }
+                if (k == 0 && i % 64 == 0) P.synchronize();
+            }
+        });
+    }
+
+    std::thread syncer([&](){
+        while (!closing.load()) {
+            P.synchronize();
+            (void)P.num_completed_tasks();
+            (void)P.done();
+            std::this_thread::yield();
+        }
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    closing = true;
+    std::thread closer1([&](){ P.close(); });
+    std::thread closer2([&](){ P.close(); });
+    closer1.join();
+    closer2.join();
+    syncer.join();
+    for (auto& t: schedulers) t.join();
+
+    assert(P.closed());
+    P.join();
+    assert(P.done());
+    assert(n_run.load() == n_accepted.load());
+    assert(P.num_scheduled_tasks() == n_accepted.load());
+    assert(P.num_completed_tasks() == n_accepted.load());
+}
+
 int main() {
     test_construction_and_resize();
     test_schedule_and_wait();
+    test_post();
     test_synchronize();
     test_early_stop_and_revive();
+    test_schedule_bulk();
+    test_parallel_for();
+    test_placement();
+    test_priorities();
+    test_starvation_guard();
+    test_elastic();
+    test_elastic_from_zero();
+    test_elastic_bulk();
+    test_elastic_latency();
+    test_nested_after_close();
+    test_task_groups();
+    test_concurrent_stress();
     return 0;
 }
@@ -0,0 +1,72 @@
+#define CLUE_THREAD_POOL_STATS
+#include <clue/thread_pool.hpp>
+#include <cstdio>
+
+using stats_t = clue::thread_pool::worker_stats;
+
+void sleep_ms(size_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+size_t total_tasks(const std::vector<stats_t>& sv) {
+    size_t n = 0;
+    for (const stats_t& s: sv) {
+        size_t h = 0;
+        for (size_t c: s.wait_hist) h += c;
+        assert(h == s.tasks_run);
+        n += s.tasks_run;
+    }
+    return n;
+}
+
+void test_stats() {
+    std::printf("TEST thread_pool: stats\n");
+    clue::thread_pool P(2);
+
+    // let the workers go idle
+    sleep_ms(20);
+    auto s0 = P.stats();
+    assert(s0.size() == 2);
+    assert(total_tasks(s0) == 0);
+    for (const stats_t& s: s0) {
+        assert(s.run_time.secs() == 0.0);
+        assert(s.idle_time.msecs() > 5.0);
+    }
+
+    // 2 tasks run immediately, the other 2 wait in the queue
+    for (size_t i = 0; i < 4; ++i) {
+        P.post([](size_t){ sleep_ms(20); });
+    }
+    P.synchronize();
+
+    auto s1 = P.stats();
+    assert(total_tasks(s1) == 4);
+    double rt = 0.0;
+    size_t n_long_waits = 0;
+    for (const stats_t& s: s1) {
+        rt += s.run_time.msecs();
+        // waits of at least 2^13 usecs (about 8 msecs)
+        for (size_t k = 14; k < stats_t::num_wait_bins; ++k) {
+            n_long_waits += s.wait_hist[k];
+        }
+    }
+    assert(rt >= 80.0);
+    assert(n_long_waits >= 2);
+
+    // reset
+    P.reset_stats();
+    auto s2 = P.stats();
+    assert(total_tasks(s2) == 0);
+    for (const stats_t& s: s2) {
+        assert(s.run_time.secs() == 0.0);
+        assert(s.idle_time.msecs() < 5.0);
+    }
+
+    P.schedule([](size_t){ sleep_ms(5); }).get();
+    P.wait_done();
+}
+
+int main() {
+    test_stats();
+    return 0;
+}
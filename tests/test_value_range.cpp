@@ -41,6 +41,7 @@ void test_unit_range(const clue::value_range<T>& rgn, const T& a, const T& b) {
     for (size_t i = 0; i < (size_t)n; ++i) {
         ASSERT_EQ(a + i, rgn[i]);
         ASSERT_EQ(a + i, rgn.at(i));
+        ASSERT_EQ(a + i, ifirst[(difference_type)i]);
     }
     ASSERT_THROW(rgn.at(size_t(n)), std::out_of_range);
 
@@ -125,6 +126,7 @@ void test_stepped_range(const clue::stepped_value_range<T, S>& rgn, const T& a,
     for (size_t i = 0; i < len; ++i) {
         ASSERT_EQ(a + i * s, rgn[i]);
         ASSERT_EQ(a + i * s, rgn.at(i));
+        ASSERT_EQ(a + i * s, ifirst[(difference_type)i]);
     }
     ASSERT_THROW(rgn.at(size_t(n)), std::out_of_range);
 
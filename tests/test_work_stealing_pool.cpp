@@ -0,0 +1,247 @@
+#include <clue/work_stealing_pool.hpp>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+
+void test_construction_and_resize() {
+    std::printf("TEST work_stealing_pool: construction + resize\n");
+    clue::work_stealing_pool P;
+
+    assert(P.empty());
+    assert(0 == P.size());
+
+    P.resize(4);
+    assert(!P.empty());
+    assert(4 == P.size());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(!P.stopped());
+    assert(!P.done());
+
+    // verify that get_thread is ok
+    for (size_t i = 0; i < 4; ++i) P.get_thread(i);
+
+    P.wait_done();
+
+    assert(0 == P.num_scheduled_tasks());
+    assert(0 == P.num_completed_tasks());
+    assert(P.closed());
+    assert(!P.stopped());
+    assert(P.done());
+    assert(P.empty());
+}
+
+void task(size_t idx, size_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void test_schedule_and_wait() {
+    std::printf("TEST work_stealing_pool: schedule + wait\n");
+    clue::work_stealing_pool P(4);
+
+    std::vector<std::future<size_t>> futs;
+    for (size_t i = 0; i < 20; ++i) {
+        futs.push_back(P.schedule([i](size_t tid){ task(tid, 5); return i; }));
+    }
+
+    P.wait_done();
+
+    for (size_t i = 0; i < 20; ++i) {
+        assert(futs[i].get() == i);
+    }
+    assert(20 == P.num_scheduled_tasks());
+    assert(20 == P.num_completed_tasks());
+    assert(P.closed());
+    assert(!P.stopped());
+    assert(P.done());
+    assert(P.empty());
+}
+
+void test_synchronize() {
+    std::printf("TEST work_stealing_pool: synchronize\n");
+    clue::work_stealing_pool P(4);
+
+    for (size_t i = 0; i < 20; ++i) {
+        P.schedule([](size_t tid){ task(tid, 10); });
+    }
+    P.synchronize();
+
+    assert(20 == P.num_completed_tasks());
+    assert(20 == P.num_scheduled_tasks());
+    assert(!P.closed());
+
+    for (size_t i = 0; i < 20; ++i) {
+        P.schedule([](size_t tid){ task(tid, 10); });
+    }
+    P.synchronize();
+
+    assert(40 == P.num_completed_tasks());
+    assert(40 == P.num_scheduled_tasks());
+    assert(!P.closed());
+
+    P.wait_done();
+
+    assert(40 == P.num_scheduled_tasks());
+    assert(40 == P.num_completed_tasks());
+    assert(P.closed());
+    assert(P.done());
+    assert(P.empty());
+}
+
+void test_concurrent_producers() {
+    std::printf("TEST work_stealing_pool: concurrent producers + post\n");
+    clue::work_stealing_pool P(4);
+
+    const size_t np = 4;
+    const size_t N = 10000;
+    std::atomic<size_t> cnt(0);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < np; ++t) {
+        producers.emplace_back([&P,&cnt,N](){
+            for (size_t i = 0; i < N; ++i) {
+                P.post([&cnt](size_t){ cnt ++; });
+            }
+        });
+    }
+    for (auto& th: producers) th.join();
+    P.synchronize();
+    assert(cnt == np * N);
+    assert(np * N == P.num_completed_tasks());
+
+    // producers racing with close: every task that is accepted is run
+    std::atomic<size_t> n_accepted(0);
+    cnt = 0;
+    producers.clear();
+    for (size_t t = 0; t < np; ++t) {
+        producers.emplace_back([&P,&cnt,&n_accepted](){
+            try {
+                for (;;) {
+                    P.post([&cnt](size_t){ cnt ++; });
+                    n_accepted ++;
+                }
+            } catch (const std::runtime_error&) {}
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    P.close();
+    for (auto& th: producers) th.join();
+    P.join();
+    assert(P.done());
+    assert(cnt == n_accepted);
+    assert(np * N + n_accepted == P.num_completed_tasks());
+}
+
+// each task spawns two children until the depth runs out,
+// so the pool has to go through 2^(d+1) - 1 tasks in total
+void spawn_tree(clue::work_stealing_pool& P, std::atomic<size_t>& cnt, size_t d) {
+    cnt ++;
+    if (d > 0) {
+        P.schedule([&P,&cnt,d](size_t tid){
+            assert(P.current_worker() == tid);
+            spawn_tree(P, cnt, d - 1);
+        });
+        P.schedule([&P,&cnt,d](size_t tid){
+            spawn_tree(P, cnt, d - 1);
+        });
+    }
+}
+
+void test_nested_spawn() {
+    std::printf("TEST work_stealing_pool: nested spawn\n");
+    clue::work_stealing_pool P(4);
+    assert(P.current_worker() == static_cast<size_t>(-1));
+
+    std::atomic<size_t> cnt(0);
+    P.schedule([&](size_t tid){ spawn_tree(P, cnt, 10); });
+    P.synchronize();
+
+    assert(cnt == 2047);
+    assert(2047 == P.num_scheduled_tasks());
+    assert(2047 == P.num_completed_tasks());
+
+    // children spawned while the pool is being closed still get done
+    cnt = 0;
+    P.schedule([&](size_t tid){ spawn_tree(P, cnt, 8); });
+    P.wait_done();
+
+    assert(cnt == 511);
+    assert(2047 + 511 == P.num_completed_tasks());
+    assert(P.done());
+}
+
+void test_fan_out_after_close() {
+    std::printf("TEST work_stealing_pool: fan-out after close\n");
+    clue::work_stealing_pool P(4);
+
+    // a running task spawns children after the pool is closed: the
+    // idle workers stay until it finishes, and steal the children
+    std::atomic<int> running(0);
+    std::atomic<int> max_running(0);
+    std::atomic<int> n_done(0);
+    std::promise<void> gate;
+    std::shared_future<void> gf = gate.get_future().share();
+    P.schedule([&, gf](size_t){
+        gf.wait();
+        for (int i = 0; i < 4; ++i) {
+            P.schedule([&](size_t){
+                int r = ++running;
+                int m = max_running.load();
+                while (r > m && !max_running.compare_exchange_weak(m, r)) {}
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                running --;
+                n_done ++;
+            });
+        }
+    });
+
+    // the sleep gives the idle workers the time to (wrongly) exit
+    P.close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.set_value();
+    P.join();
+    assert(P.done());
+    assert(n_done.load() == 4);
+    assert(max_running.load() >= 2);
+    assert(P.num_completed_tasks() == 5);
+}
+
+void test_early_stop_and_revive() {
+    std::printf("TEST work_stealing_pool: early stop + revive\n");
+    clue::work_stealing_pool P(2);
+
+    for (size_t i = 0; i < 10; ++i) {
+        P.schedule([](size_t tid){ task(tid, 50); });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(25));
+    P.stop_and_wait();  // will wait for active tasks to finish
+
+    assert(10 == P.num_scheduled_tasks());
+    assert(P.num_completed_tasks() < 10);
+    assert(P.closed());
+    assert(P.stopped());
+    assert(!P.done());
+    assert(P.empty());
+
+    P.resize(3);
+    P.wait_done();
+
+    assert(10 == P.num_scheduled_tasks());
+    assert(10 == P.num_completed_tasks());
+    assert(P.closed());
+    assert(!P.stopped());
+    assert(P.done());
+    assert(P.empty());
+}
+
+
+int main() {
+    test_construction_and_resize();
+    test_schedule_and_wait();
+    test_synchronize();
+    test_concurrent_producers();
+    test_nested_spawn();
+    test_fan_out_after_close();
+    test_early_stop_and_revive();
+    return 0;
+}